@@ -0,0 +1,102 @@
+"""
+File Name : module_bench.py
+Description : compare the polls of a capture through ctypes and through the
+              module vt100_screen, and the page records with the page built
+              from GetSelectPage/GetWholePage in python
+usage : python3 module_bench.py <library> <capture> [client|server] [poll bytes]
+        the module vt100_screen is imported from the working directory
+"""
+
+import ctypes
+import json
+import os
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.dirname(os.path.abspath(__file__))), 'test'))
+sys.path.insert(0, os.getcwd())
+import vt100_lib
+
+PAGE_RECORD_JSON = 0
+PAGE_RECORD_ROWS = 0x01
+REPEAT = 5
+
+
+def best(func):
+    # the fastest of REPEAT runs, in us per poll
+    return min(func() for _ in range(REPEAT)) * 1e6
+
+
+def main():
+    os.environ['VT100_SCREEN_LIB'] = sys.argv[1]
+    lib = vt100_lib.load()
+    lib.GetPageRecordBuffer.restype = ctypes.c_void_p
+    lib.GetPageRecordBuffer.argtypes = [ctypes.c_int, ctypes.c_int, ctypes.POINTER(ctypes.c_int)]
+    capture = open(sys.argv[2], 'rb').read()
+    platform = sys.argv[3] if len(sys.argv) > 3 else 'client'
+    poll_bytes = int(sys.argv[4]) if len(sys.argv) > 4 else 4096
+    polls = [capture[i:i + poll_bytes] for i in range(0, len(capture), poll_bytes)]
+
+    def ctypes_page():
+        lib.Init(platform.encode())
+        begin = time.perf_counter()
+        for poll in polls:
+            lib.FeedBytes(poll, len(poll))
+            lib.GetSelectPage().values()
+        return (time.perf_counter() - begin) / len(polls)
+
+    def ctypes_record():
+        # the page as the logs wrote it before GetPageRecordBuffer()
+        lib.Init(platform.encode())
+        begin = time.perf_counter()
+        for poll in polls:
+            lib.FeedBytes(poll, len(poll))
+            page = lib.GetSelectPage()
+            whole = lib.GetWholePage()
+            lib.GetScreenColored()
+            record = {'titles': page.titles.decode('latin-1'),
+                      'description': page.description.decode('latin-1'),
+                      'highlight_idx': page.highlight_idx,
+                      'is_scrollable_up': page.is_scrollable_up,
+                      'is_scrollable_down': page.is_scrollable_down,
+                      'is_dialog_box': page.is_dialog_box,
+                      'is_popup': page.is_popup,
+                      'entries': [[page.entries[i][0].value.decode('latin-1'), page.entries[i][1].value.decode('latin-1'),
+                                   int(page.entries[i][2].value)] for i in range(page.entries_count)],
+                      'rows': [row.decode('latin-1') for row in whole.rows()]}
+            json.dumps(record, separators=(',', ':'))
+        return (time.perf_counter() - begin) / len(polls)
+
+    def page_record():
+        lib.Init(platform.encode())
+        size = ctypes.c_int()
+        begin = time.perf_counter()
+        for poll in polls:
+            lib.FeedBytes(poll, len(poll))
+            ctypes.string_at(lib.GetPageRecordBuffer(PAGE_RECORD_JSON, PAGE_RECORD_ROWS, ctypes.byref(size)), size.value)
+        return (time.perf_counter() - begin) / len(polls)
+
+    print('%s: %d polls of %d bytes, %s' % (sys.argv[2], len(polls), poll_bytes, platform))
+    print('%-40s %9.1f us/poll' % ('ctypes FeedBytes + GetSelectPage', best(ctypes_page)))
+    try:
+        import vt100_screen
+    except ImportError:
+        vt100_screen = None
+    if vt100_screen is not None:
+        def module_page():
+            parser = vt100_screen.Parser(platform)
+            begin = time.perf_counter()
+            for poll in polls:
+                parser.feed(poll)
+                parser.select_page()
+            return (time.perf_counter() - begin) / len(polls)
+        print('%-40s %9.1f us/poll' % ('vt100_screen feed + select_page', best(module_page)))
+    else:
+        print('vt100_screen is not built, see "How to build?"')
+    for name, func in (('ctypes 3 pages + json.dumps', ctypes_record), ('GetPageRecordBuffer json rows', page_record)):
+        us = best(func)
+        print('%-40s %9.1f us/poll %9.0f pages/s' % (name, us, 1e6 / us))
+
+
+if __name__ == '__main__':
+    main()
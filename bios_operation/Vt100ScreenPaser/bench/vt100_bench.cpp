@@ -0,0 +1,252 @@
+/*
+File Name : vt100_bench.cpp
+Description : replay a serial capture through a build of the library and
+              report the time and the heap allocations of the exports. The
+              library is loaded by its path, so the builds of two commits
+              are compared on the same capture.
+*/
+
+#include "../vt100_screen_parse.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <sstream>
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// the allocations of the library are counted here, the executable is linked
+// with -rdynamic so the library calls this operator new
+static long long alloc_count = 0;
+static long long alloc_bytes = 0;
+
+void *operator new(size_t size)
+{
+    alloc_count++;
+    alloc_bytes += size;
+    void *ptr = malloc(size ? size : 1);
+    if (ptr == NULL)
+        throw std::bad_alloc();
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+typedef void (*InitFunc)(const char *);
+typedef void (*FeedFunc)(const char *);
+typedef void (*FeedBytesFunc)(const uint8_t *, size_t);
+typedef SelectPage (*GetSelectPageFunc)();
+typedef char *(*GetValueByKeyFunc)(const char *);
+typedef const char *(*GetPageRecordBufferFunc)(int, int, int *);
+
+struct Library
+{
+    InitFunc Init;
+    FeedFunc Feed;
+    FeedBytesFunc FeedBytes; // NULL before FeedBytes() is exported
+    GetSelectPageFunc GetSelectPage;
+    GetValueByKeyFunc GetValueByKey;
+    GetPageRecordBufferFunc GetPageRecordBuffer;
+};
+
+struct Measure
+{
+    double seconds;
+    long long calls;
+    long long allocs;
+    long long bytes;
+    std::chrono::steady_clock::time_point begin;
+    long long begin_allocs;
+    long long begin_bytes;
+
+    Measure() : seconds(0), calls(0), allocs(0), bytes(0), begin_allocs(0), begin_bytes(0) {}
+
+    void Begin()
+    {
+        begin_allocs = alloc_count;
+        begin_bytes = alloc_bytes;
+        begin = std::chrono::steady_clock::now();
+    }
+
+    void End()
+    {
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        allocs += alloc_count - begin_allocs;
+        bytes += alloc_bytes - begin_bytes;
+        calls++;
+    }
+};
+
+static int stdout_fd = -1;
+
+static void Quiet(bool quiet)
+{
+    // the library prints its errors to stdout, they are dropped while measuring
+    fflush(stdout);
+    std::cout.flush();
+    if (quiet)
+    {
+        stdout_fd = dup(1);
+        int null_fd = open("/dev/null", O_WRONLY);
+        dup2(null_fd, 1);
+        close(null_fd);
+    }
+    else
+    {
+        dup2(stdout_fd, 1);
+        close(stdout_fd);
+    }
+}
+
+static void Feed(const Library &lib, const std::string &poll)
+{
+    if (lib.FeedBytes != NULL)
+        lib.FeedBytes((const uint8_t *)poll.data(), poll.size());
+    else
+        lib.Feed(poll.c_str());
+}
+
+static void Report(const char *name, const Measure &measure)
+{
+    printf("%-32s %9.2f us/call %9.1f allocs/call %10.0f bytes/call\n", name, measure.seconds * 1e6 / measure.calls,
+           (double)measure.allocs / measure.calls, (double)measure.bytes / measure.calls);
+}
+
+int main(int argc, char *argv[])
+{
+    /*
+        vt100_bench <library> <capture> [client|server] [poll bytes] [passes]
+        the capture is the serial data as it is read from the port, it is fed
+        in polls of poll bytes (4096) and every export is measured after each
+        poll. The first pass is not measured.
+    */
+    if (argc < 3)
+    {
+        printf("usage: %s <library> <capture> [client|server] [poll bytes] [passes]\n", argv[0]);
+        return 1;
+    }
+    const char *platform = argc > 3 ? argv[3] : "client";
+    size_t poll_bytes = argc > 4 ? strtoul(argv[4], NULL, 10) : 4096;
+    int passes = argc > 5 ? atoi(argv[5]) : 3;
+
+    void *handle = dlopen(argv[1], RTLD_NOW);
+    if (handle == NULL)
+    {
+        printf("Error: %s\n", dlerror());
+        return 1;
+    }
+    Library lib;
+    lib.Init = (InitFunc)dlsym(handle, "Init");
+    lib.Feed = (FeedFunc)dlsym(handle, "Feed");
+    lib.FeedBytes = (FeedBytesFunc)dlsym(handle, "FeedBytes");
+    lib.GetSelectPage = (GetSelectPageFunc)dlsym(handle, "GetSelectPage");
+    lib.GetValueByKey = (GetValueByKeyFunc)dlsym(handle, "GetValueByKey");
+    lib.GetPageRecordBuffer = (GetPageRecordBufferFunc)dlsym(handle, "GetPageRecordBuffer");
+    if (lib.Init == NULL || lib.Feed == NULL || lib.GetSelectPage == NULL || lib.GetValueByKey == NULL)
+    {
+        printf("Error: %s is not a Vt100ScreenPaser library\n", argv[1]);
+        return 1;
+    }
+
+    std::ifstream capture_file(argv[2], std::ios::binary);
+    if (!capture_file.is_open())
+    {
+        printf("Error: can not read %s\n", argv[2]);
+        return 1;
+    }
+    std::stringstream capture_stream;
+    capture_stream << capture_file.rdbuf();
+    std::string capture = capture_stream.str();
+    if (lib.FeedBytes == NULL)
+    {
+        // Feed() stops at NUL
+        for (size_t i = 0; i < capture.size(); i++)
+        {
+            if (capture[i] == '\0')
+                capture[i] = ' ';
+        }
+    }
+    std::vector<std::string> polls;
+    for (size_t beg = 0; beg < capture.size(); beg += poll_bytes)
+        polls.push_back(capture.substr(beg, poll_bytes));
+
+    // the keys of the highlight entries of the first pass are queried
+    std::vector<std::string> keys;
+    Measure feed, select_page, select_page_cached, value_by_key;
+    Measure record[2][2]; // format, rows
+    static const char *const kRecordNames[2][2] = {{"GetPageRecordBuffer json", "GetPageRecordBuffer json rows"},
+                                                   {"GetPageRecordBuffer msgpack", "GetPageRecordBuffer msgpack rows"}};
+    Quiet(true);
+    for (int pass = 0; pass < passes + 1; pass++)
+    {
+        bool measured = pass > 0;
+        lib.Init(platform);
+        for (size_t i = 0; i < polls.size(); i++)
+        {
+            Measure ignored;
+            Measure &feed_measure = measured ? feed : ignored;
+            feed_measure.Begin();
+            Feed(lib, polls[i]);
+            feed_measure.End();
+
+            // a new page, then the same page again
+            Measure &page_measure = measured ? select_page : ignored;
+            page_measure.Begin();
+            SelectPage page = lib.GetSelectPage();
+            page_measure.End();
+            Measure &cached_measure = measured ? select_page_cached : ignored;
+            cached_measure.Begin();
+            lib.GetSelectPage();
+            cached_measure.End();
+            if (pass == 0 && page.highlight_idx >= 0 && page.highlight_idx < page.entries_count)
+                keys.push_back(page.entries[page.highlight_idx][0]);
+
+            if (measured && !keys.empty())
+            {
+                value_by_key.Begin();
+                lib.GetValueByKey(keys[i % keys.size()].c_str());
+                value_by_key.End();
+            }
+            for (int format = 0; format < 2 && lib.GetPageRecordBuffer != NULL; format++)
+            {
+                for (int rows = 0; rows < 2; rows++)
+                {
+                    int size = 0;
+                    Measure &record_measure = measured ? record[format][rows] : ignored;
+                    record_measure.Begin();
+                    lib.GetPageRecordBuffer(format == 0 ? PAGE_RECORD_JSON : PAGE_RECORD_MSGPACK, rows ? PAGE_RECORD_ROWS : 0, &size);
+                    record_measure.End();
+                }
+            }
+        }
+    }
+    Quiet(false);
+
+    printf("%s: %zu bytes in %zu polls of %zu bytes, %s, %d passes\n", argv[2], capture.size(), polls.size(), poll_bytes,
+           platform, passes);
+    printf("%-32s %9.1f MB/s\n", "serial data",
+           capture.size() * (double)passes / feed.seconds / 1e6);
+    Report(lib.FeedBytes != NULL ? "FeedBytes" : "Feed", feed);
+    Report("GetSelectPage", select_page);
+    Report("GetSelectPage same page", select_page_cached);
+    if (value_by_key.calls > 0)
+        Report("GetValueByKey", value_by_key);
+    for (int format = 0; format < 2 && lib.GetPageRecordBuffer != NULL; format++)
+    {
+        for (int rows = 0; rows < 2; rows++)
+            Report(kRecordNames[format][rows], record[format][rows]);
+    }
+    return 0;
+}
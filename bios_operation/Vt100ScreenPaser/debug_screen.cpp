@@ -10,20 +10,39 @@ Description : This file is designed to analyze serial port data.
 #endif 
 
 #include "debug_screen.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <sstream>
 #include <vector>
 using namespace std;
 
-Vt100Cmd::Vt100Cmd(string description, vector<string> params)
+Vt100Cmd::Vt100Cmd(unsigned char op, short param0, short param1, unsigned char flags)
 {
-    description_ = description;
-    params_ = params;
+    op_ = op;
+    flags_ = flags;
+    params_[0] = param0;
+    params_[1] = param1;
+    offset_ = 0;
+    length_ = 0;
+}
+
+ByteSpan::ByteSpan(const uint8_t *data, size_t size)
+{
+    data_ = data;
+    size_ = size;
+}
+
+ByteSpan::ByteSpan(const string &str)
+{
+    data_ = (const uint8_t *)str.data();
+    size_ = str.size();
 }
 
 void Strcpy(char chs[], string str, int len)
 {
-    len = str.length() < len - 1 ? str.length() : len - 1;
+    len = (int)str.length() < len - 1 ? (int)str.length() : len - 1;
     // cout << sizeof(chs) << " " << len << endl;
     for (int i = 0; i < len; i++)
     {
@@ -64,6 +83,34 @@ vector<string> strsplit(string input_str, string delim)
     return res;
 }
 
+short ParamValue(const char *param, size_t len, bool *from_end)
+{
+    /*
+        Function Name       : ParamValue()
+        Parameters          : param, len: the parameter chars of an escape sequence
+                              from_end: set if the parameter is written as ":n"
+        Functionality       : convert the parameter as atoi() does, ":n" is used
+                              by the bios for 100 and above, the caller counts it
+                              from the screen width or height.
+        Return Value        : the parameter value
+    */
+    size_t i = 0;
+    bool is_from_end = len > 0 && param[0] == ':';
+    if (from_end != NULL)
+        *from_end = is_from_end;
+    if (is_from_end)
+        i++;
+    while (i < len && isspace((unsigned char)param[i]))
+        i++;
+    bool negative = false;
+    if (i < len && (param[i] == '+' || param[i] == '-'))
+        negative = param[i++] == '-';
+    int value = 0;
+    while (i < len && isdigit((unsigned char)param[i]) && value < 10000)
+        value = value * 10 + (param[i++] - '0');
+    return (short)(negative ? -value : value);
+}
+
 void strreplace(string &input_str, string old_str, string new_str)
 {
     /*
@@ -87,14 +134,16 @@ void strreplace(string &input_str, string old_str, string new_str)
     }
 }
 
-DebugScreen::DebugScreen(bool is_edk_shell)
+DebugScreen::DebugScreen(bool is_edk_shell, int engine) : state_machine_(is_edk_shell)
 {
     /*
     Function Name       : DebugScreen()
     Parameters          : is_edk_shell: current status is in edk shell or not.
+                          engine: SPLIT_ENGINE_STATE_MACHINE or SPLIT_ENGINE_REGEX
     Functionality       : Initialize config information
     Return Value        : None
     */
+    engine_ = engine;
     ParseConfig display_accributes;
     if (is_edk_shell == true)
         display_accributes.RegularExpression = "\\d{1,2}m(.|\\n|\\r)*";
@@ -102,6 +151,7 @@ DebugScreen::DebugScreen(bool is_edk_shell)
         display_accributes.RegularExpression = "^\\d{1,2}m$";
     display_accributes.Description = "display_attributes";
     display_accributes.MarkChar = "m";
+    display_accributes.Op = VT100_CMD_DISPLAY_ATTRIBUTES;
     regex da_pattern(display_accributes.RegularExpression);
     display_accributes.RegPattern = da_pattern;
 
@@ -112,6 +162,7 @@ DebugScreen::DebugScreen(bool is_edk_shell)
         cursor_position.RegularExpression = ".{1,2};.{1,2}H.*";
     cursor_position.Description = "cursor_position_start";
     cursor_position.MarkChar = ";,H";
+    cursor_position.Op = VT100_CMD_CURSOR_POSITION;
     regex cp_pattern(cursor_position.RegularExpression);
     cursor_position.RegPattern = cp_pattern;
 
@@ -136,7 +187,7 @@ vector<string> DebugScreen::GetSegmentWordInfo(string markchars, string pattern_
     string::size_type start_index = 0;
     for (auto it = markchars_split.begin(); it != markchars_split.end(); it++)
     {
-        int end_index = pattern_result.find(*it);
+        string::size_type end_index = pattern_result.find(*it);
         if (end_index != string::npos)
         {
             int val_length = end_index - start_index;
@@ -148,17 +199,17 @@ vector<string> DebugScreen::GetSegmentWordInfo(string markchars, string pattern_
     return parm_attr_val;
 }
 
-vector<Vt100Cmd> DebugScreen::GetScreenInfo(string serial_data, bool in_bios = true, bool ec_off = false)
+void DebugScreen::GetScreenInfo(string serial_data, vector<Vt100Cmd> &screen_info)
 {
     /*
         Function Name   :GetScreenInfo()
-        Parameter       :serial_data:the serial data from serial port
-                         in_bios: serial data get from bios or not
-                         ec_off: turn off ec related data or not
+        Parameter       :serial_data:the serial data from serial port, the logs
+                         are already removed by the noise filter
+                         screen_info: the Vt100Cmd objects are appended to it,
+                         the draw text is kept in payload_
         Functionality   :parse the serial data
-        Return          :vector Vt100Cmd objects
+        Return          :None
     */
-    vector<Vt100Cmd> screen_info;
     strreplace(serial_data, "\x1b[2J\x1b[01;01H", "");
     string split_chars = "\x1b";
     vector<string> serial_splitinfo = strsplit(serial_data, split_chars);
@@ -167,101 +218,906 @@ vector<Vt100Cmd> DebugScreen::GetScreenInfo(string serial_data, bool in_bios = t
         string segment_words = *it;
         if (segment_words != "")
         {
-            if (in_bios == true)
-            {
-                string ec_end_mark = "\r\n";
-                string::size_type ec_start_index = segment_words.find("EC Command:");
-                string::size_type ec_end_index = segment_words.rfind(ec_end_mark);
-                // in EC Command in segment_words
-                if (ec_start_index != string::npos && ec_end_index != string::npos)
-                {
-                    segment_words = segment_words.substr(0, ec_start_index) + segment_words.substr((ec_end_index + ec_end_mark.size()));
-                }
-                string::size_type fv_start_index = segment_words.find("FvbProtocolWrite:");
-                string::size_type fv_end_index = segment_words.rfind(ec_end_mark);
-                if (fv_start_index != string::npos && fv_end_index != string::npos)
-                {
-                    segment_words = segment_words.substr(0, fv_start_index) + segment_words.substr((fv_end_index + ec_end_mark.size()));
-                }
-            }
-            else if (ec_off == true)
-            {
-                while (true)
-                {
-                    string ec_end_mark = "\r\n";
-                    string::size_type ec_start_index = segment_words.find("EC Command:");
-                    if (ec_start_index == string::npos)
-                        break;
-                    string ec_data = segment_words.substr(ec_start_index);
-                    string::size_type ec_end_index = ec_data.find("Receiving EC Data:");
-                    if (ec_start_index != string::npos && ec_end_index != string::npos)
-                    {
-                        ec_end_index += ec_start_index;
-                        string end_index_data = segment_words.substr(ec_end_index);
-                        string::size_type end_index = end_index_data.find(ec_end_mark);
-                        if (end_index != string::npos)
-                        {
-                            end_index = ec_end_index + end_index + ec_end_mark.size();
-                        }
-                        else
-                        {
-                            break;
-                        }
-                        segment_words = segment_words.substr(0, ec_start_index) + segment_words.substr(end_index);
-                    }
-                    else
-                    {
-                        break;
-                    }
-                }
-            }
             if (segment_words.substr(0, 1) == "[")
                 segment_words = segment_words.substr(1);
             for (auto it2 = cfg_file_info_.begin(); it2 != cfg_file_info_.end(); it2++)
             {
-                ParseConfig cfg_info = *it2;
-                string dec = cfg_info.Description;
-                string markchars = cfg_info.MarkChar;
+                const ParseConfig &cfg_info = *it2;
+                const string &markchars = cfg_info.MarkChar;
 
-                bool is_matched = regex_match(segment_words.substr(0, segment_words.size() < 100 ? segment_words.size() : 100), cfg_info.RegPattern);
+                bool is_matched = regex_match(segment_words.substr(0, segment_words.size() < REGEX_MAX_STACK_COUNT ? segment_words.size() : REGEX_MAX_STACK_COUNT), cfg_info.RegPattern);
                 if (is_matched == true)
                 {
                     vector<string> parm_attr_val = GetSegmentWordInfo(markchars, segment_words);
+                    string content = "";
                     if (parm_attr_val.size() > 2)
                     {
-                        vector<string> parm = {parm_attr_val[0], parm_attr_val[1]};
-                        screen_info.push_back(Vt100Cmd(dec, parm));
-                        vector<string> content = {parm_attr_val[2]};
-                        string content_key = "draw";
-                        screen_info.push_back(Vt100Cmd(content_key, content));
+                        bool row_from_end = false;
+                        bool col_from_end = false;
+                        short row = ParamValue(parm_attr_val[0].data(), parm_attr_val[0].size(), &row_from_end);
+                        short col = ParamValue(parm_attr_val[1].data(), parm_attr_val[1].size(), &col_from_end);
+                        unsigned char flags = (row_from_end ? VT100_FLAG_ROW_FROM_END : 0) | (col_from_end ? VT100_FLAG_COL_FROM_END : 0);
+                        screen_info.push_back(Vt100Cmd(cfg_info.Op, row, col, flags));
+                        content = parm_attr_val[2];
                     }
                     else if (parm_attr_val.size() == 2)
                     {
-                        vector<string> parm = {parm_attr_val[0]};
-                        screen_info.push_back(Vt100Cmd(dec, parm));
-                        if (parm_attr_val[1] != "")
-                        {
-                            string content_key = "draw";
-                            vector<string> content = {parm_attr_val[1]};
-                            screen_info.push_back(Vt100Cmd(content_key, content));
-                        }
+                        screen_info.push_back(Vt100Cmd(cfg_info.Op, ParamValue(parm_attr_val[0].data(), parm_attr_val[0].size(), NULL)));
+                        content = parm_attr_val[1];
+                    }
+                    if (content != "")
+                    {
+                        Vt100Cmd draw(VT100_CMD_DRAW, 0, 0, VT100_FLAG_PAYLOAD);
+                        draw.offset_ = payload_.size();
+                        draw.length_ = content.size();
+                        payload_ += content;
+                        screen_info.push_back(draw);
                     }
                 }
             }
         }
     }
-    return screen_info;
 }
 
-vector<Vt100Cmd> DebugScreen::SerialOutputSplit(string serial_output, bool in_bios, bool ec_off)
+void DebugScreen::SerialOutputSplit(const string &serial_output, vector<Vt100Cmd> &cmds, bool in_bios, bool ec_off, bool end_of_input)
+{
+    SerialOutputSplit(serial_output.data(), serial_output.size(), cmds, in_bios, ec_off, end_of_input);
+}
+
+void DebugScreen::SerialOutputSplit(const char *data, size_t len, vector<Vt100Cmd> &cmds, bool in_bios, bool ec_off, bool end_of_input)
 {
     /*
         Function Name   :SerialOutputSplit()
-        Parameters      :serial_output: the serial data output from serial port
+        Parameters      :data, len: the serial data output from serial port,
+                         NUL is not taken as the end
+                         cmds: the Vt100Cmd objects are appended to it
+                         in_bios: serial data get from bios or not
+                         ec_off: turn off ec related data or not
+                         end_of_input: no data follows, the noise filter
+                         keeps nothing for the next call
         Functionality   :Convert the serial output to 'Vt100Cmd' object that
-                         describe the debug information.
-        Return          :A vector of Vt100Cmd objects.
+                         describe the debug information. The logs printed
+                         into the serial data are removed by the noise filter
+                         first. The draw text refers to data or to the payload,
+                         read it by GetText() before the next call.
+        Return          :None
     */
-    vector<Vt100Cmd> parse_ret = GetScreenInfo(serial_output, in_bios, ec_off);
-    return parse_ret;
+    payload_.clear();
+    const vector<ByteSpan> &runs = noise_filter_.Filter(data, len, in_bios, ec_off, end_of_input);
+    if (engine_ == SPLIT_ENGINE_REGEX)
+    {
+        string serial_data;
+        for (auto it = runs.begin(); it != runs.end(); it++)
+            serial_data.append((const char *)it->data_, it->size_);
+        GetScreenInfo(serial_data, cmds);
+    }
+    else
+    {
+        state_machine_.Consume(data, len, runs, cmds, payload_);
+    }
+}
+
+const string &DebugScreen::SplitHeld(vector<Vt100Cmd> &cmds)
+{
+    /*
+        Function Name   :SplitHeld()
+        Parameters      :cmds: the Vt100Cmd objects are appended to it
+        Functionality   :split the bytes the noise filter keeps at the end of
+                         the last input as if no data followed. They are not
+                         consumed, the next SerialOutputSplit() still removes
+                         them if they start a log. Only the state machine engine
+                         continues a draw in the next input, so the regex
+                         engine splits nothing.
+        Return          :the bytes kept, the serial output of GetText()
+    */
+    payload_.clear();
+    const string &held = noise_filter_.GetHeld();
+    if (held.empty() || engine_ != SPLIT_ENGINE_STATE_MACHINE)
+        return held;
+    Vt100StateMachine state_machine = state_machine_;
+    vector<ByteSpan> runs(1, ByteSpan(held));
+    state_machine.Consume(held.data(), held.size(), runs, cmds, payload_);
+    return held;
+}
+
+const char *DebugScreen::GetText(const Vt100Cmd &cmd, const char *serial_output)
+{
+    /*
+        Function Name   :GetText()
+        Parameters      :cmd: a VT100_CMD_DRAW command of the last SerialOutputSplit()
+                         serial_output: the serial data passed to SerialOutputSplit()
+        Functionality   :locate the text of the draw command
+        Return          :pointer to cmd.length_ chars
+    */
+    if (cmd.flags_ & VT100_FLAG_PAYLOAD)
+        return payload_.data() + cmd.offset_;
+    return serial_output + cmd.offset_;
+}
+
+void DebugScreen::SetEngine(int engine)
+{
+    /*
+        Function Name   :SetEngine()
+        Parameters      :engine: SPLIT_ENGINE_STATE_MACHINE or SPLIT_ENGINE_REGEX
+        Functionality   :select the engine used by SerialOutputSplit(), the state
+                         machine drops the partial sequence it kept when switched.
+        Return          :None
+    */
+    if (engine != SPLIT_ENGINE_REGEX && engine != SPLIT_ENGINE_STATE_MACHINE)
+    {
+        cout << "split engine " << engine << " not support" << endl;
+        return;
+    }
+    if (engine != engine_)
+    {
+        state_machine_.Reset();
+        noise_filter_.Reset();
+    }
+    engine_ = engine;
+}
+
+int DebugScreen::GetEngine()
+{
+    return engine_;
+}
+
+bool DebugScreen::LoadNoiseFilter(const string &file)
+{
+    return noise_filter_.LoadConfig(file);
+}
+
+void DebugScreen::SetNoiseFilter(const vector<NoiseFilterConfig> &cfg_info)
+{
+    noise_filter_.SetConfig(cfg_info);
+}
+
+const vector<NoiseFilterConfig> &DebugScreen::GetNoiseFilter()
+{
+    return noise_filter_.GetConfig();
+}
+
+int DebugScreen::GetNoiseFilterHits(const string &pattern)
+{
+    return noise_filter_.GetHits(pattern);
+}
+
+void DebugScreen::Reset()
+{
+    // drop the partial sequence and the log kept from the last SerialOutputSplit()
+    state_machine_.Reset();
+    noise_filter_.Reset();
+    payload_.clear();
+}
+
+#define VT100_ESC_CHAR '\x1b'
+
+// byte classes of the VT100 state machine
+enum
+{
+    CLASS_OTHER,
+    CLASS_ESC,
+    CLASS_BRACKET,
+    CLASS_DIGIT,
+    CLASS_SEMICOLON,
+    CLASS_CURSOR_END,
+    CLASS_ATTRIBUTE_END,
+    CLASS_EOL,
+    CLASS_NUL,
+    CLASS_COUNT
+};
+
+// states of the VT100 state machine, the states from STATE_ATTRIBUTE on
+// consume the segment body
+enum
+{
+    STATE_START,     // after ESC, one '[' is optional
+    STATE_PARAM0,    // 1 or 2 chars before ';' or 'm'
+    STATE_PARAM1,    // 1 or 2 chars before 'H'
+    STATE_ATTRIBUTE, // after "\d{1,2}m"
+    STATE_CURSOR,    // after ".{1,2};.{1,2}H", the body is drawn at the cursor
+    STATE_SKIP       // segment not supported, drop bytes until next ESC
+};
+
+enum
+{
+    ACTION_BRACKET,
+    ACTION_PARAM0,
+    ACTION_PARAM1_BEGIN,
+    ACTION_PARAM1,
+    ACTION_ATTRIBUTE,
+    ACTION_CURSOR,
+    ACTION_SKIP,
+    ACTION_IGNORE
+};
+
+static const struct ByteClassTable
+{
+    unsigned char classes[256];
+    ByteClassTable()
+    {
+        for (int i = 0; i < 256; i++)
+            classes[i] = (i >= '0' && i <= '9') ? CLASS_DIGIT : CLASS_OTHER;
+        classes[(unsigned char)VT100_ESC_CHAR] = CLASS_ESC;
+        classes[(unsigned char)'['] = CLASS_BRACKET;
+        classes[(unsigned char)';'] = CLASS_SEMICOLON;
+        classes[(unsigned char)'H'] = CLASS_CURSOR_END;
+        classes[(unsigned char)'m'] = CLASS_ATTRIBUTE_END;
+        classes[(unsigned char)'\r'] = CLASS_EOL;
+        classes[(unsigned char)'\n'] = CLASS_EOL;
+        classes[0] = CLASS_NUL;
+    }
+} kByteClass;
+
+// action of each byte class in the header states, ESC is handled before the
+// table and NUL is ignored as a VT100 terminal does
+static const unsigned char kHeadAction[STATE_ATTRIBUTE][CLASS_COUNT] = {
+    // OTHER        ESC          BRACKET         DIGIT          SEMICOLON            CURSOR_END     ATTRIBUTE_END     EOL          NUL
+    {ACTION_PARAM0, ACTION_SKIP, ACTION_BRACKET, ACTION_PARAM0, ACTION_SKIP, ACTION_PARAM0, ACTION_PARAM0, ACTION_SKIP, ACTION_IGNORE},         // STATE_START
+    {ACTION_PARAM0, ACTION_SKIP, ACTION_PARAM0, ACTION_PARAM0, ACTION_PARAM1_BEGIN, ACTION_PARAM0, ACTION_ATTRIBUTE, ACTION_SKIP, ACTION_IGNORE}, // STATE_PARAM0
+    {ACTION_PARAM1, ACTION_SKIP, ACTION_PARAM1, ACTION_PARAM1, ACTION_PARAM1, ACTION_CURSOR, ACTION_PARAM1, ACTION_SKIP, ACTION_IGNORE},         // STATE_PARAM1
+};
+
+static const char kClearHome[] = "\x1b[2J\x1b[01;01H";
+
+Vt100StateMachine::Vt100StateMachine(bool is_edk_shell)
+{
+    /*
+        Function Name   :Vt100StateMachine()
+        Parameters      :is_edk_shell: parse the edk shell output or the bios screen
+        Functionality   :a resumable tokenizer, it keeps the unfinished escape
+                         sequence between Consume() calls and reports the same
+                         Vt100Cmd as the regex engine without splitting strings.
+        Return          :None
+    */
+    is_edk_shell_ = is_edk_shell;
+    input_ = NULL;
+    input_len_ = 0;
+    cmds_ = NULL;
+    payload_ = NULL;
+    Reset();
+}
+
+void Vt100StateMachine::Reset()
+{
+    clear_pos_ = 0;
+    BeginSegment();
+}
+
+void Vt100StateMachine::BeginSegment()
+{
+    state_ = STATE_START;
+    seg_pos_ = 0;
+    first_eol_ = -1;
+    head_emitted_ = false;
+    params_len_[0] = 0;
+    params_len_[1] = 0;
+    param0_digit_ = true;
+    head_.clear();
+    BeginPiece();
+}
+
+void Vt100StateMachine::BeginPiece()
+{
+    piece_state_ = state_;
+    piece_seg_pos_ = seg_pos_;
+    piece_first_eol_ = first_eol_;
+    piece_head_emitted_ = head_emitted_;
+    body_ = NULL;
+    body_len_ = 0;
+    body_copied_ = false;
+    body_copy_.clear();
+}
+
+void Vt100StateMachine::AppendBody(const char *data, size_t len)
+{
+    // the body is a view of the input, it is copied only when the clear
+    // screen sequence or a log cut it into two parts, or when it starts
+    // in the bytes the noise filter kept from the last input
+    if (len == 0)
+        return;
+    bool in_input = data >= input_ && data < input_ + input_len_;
+    if (!body_copied_ && body_len_ == 0 && in_input)
+    {
+        body_ = data;
+        body_len_ = len;
+    }
+    else if (!body_copied_ && body_ + body_len_ == data)
+    {
+        body_len_ += len;
+    }
+    else
+    {
+        if (!body_copied_)
+        {
+            body_copy_.assign(body_, body_len_);
+            body_copied_ = true;
+        }
+        body_copy_.append(data, len);
+    }
+}
+
+void Vt100StateMachine::EmitDraw()
+{
+    // the body is reported as offset in the input, a copied body is moved
+    // to the payload
+    Vt100Cmd draw(VT100_CMD_DRAW);
+    if (body_copied_)
+    {
+        draw.flags_ = VT100_FLAG_PAYLOAD;
+        draw.offset_ = payload_->size();
+        draw.length_ = body_copy_.size();
+        payload_->append(body_copy_);
+    }
+    else
+    {
+        draw.offset_ = body_ - input_;
+        draw.length_ = body_len_;
+    }
+    if (draw.length_ > 0)
+        cmds_->push_back(draw);
+}
+
+void Vt100StateMachine::Tokenize(const char *data, size_t len)
+{
+    /*
+        Function Name   :Tokenize()
+        Parameters      :data, len: bytes of the stream, the clear screen sequence
+                         is already removed
+        Functionality   :run every byte through the state machine once, the body
+                         of a segment is collected as a view and handled when the
+                         segment or the piece ends.
+        Return          :None
+    */
+    const char *p = data;
+    const char *end = data + len;
+    while (p < end)
+    {
+        if (state_ >= STATE_ATTRIBUTE)
+        {
+            const char *run = p;
+            while (p < end && *p != VT100_ESC_CHAR)
+            {
+                if (first_eol_ == -1 && (*p == '\r' || *p == '\n'))
+                    first_eol_ = seg_pos_ + (int)(p - run);
+                p++;
+            }
+            seg_pos_ += (int)(p - run);
+            AppendBody(run, p - run);
+            if (p == end)
+                break;
+        }
+
+        unsigned char ch = (unsigned char)*p++;
+        int byte_class = kByteClass.classes[ch];
+        if (byte_class == CLASS_ESC)
+        {
+            FinishPiece(true);
+            BeginSegment();
+            continue;
+        }
+        int action = kHeadAction[state_][byte_class];
+        if (action == ACTION_IGNORE)
+            continue;
+        head_.push_back(ch);
+        if (action != ACTION_BRACKET)
+            seg_pos_++;
+        if (action == ACTION_ATTRIBUTE && !(params_len_[0] > 0 && param0_digit_))
+            action = ACTION_PARAM0;
+        switch (action)
+        {
+        case ACTION_BRACKET:
+            state_ = STATE_PARAM0;
+            break;
+        case ACTION_PARAM0:
+            if (params_len_[0] == 2)
+            {
+                state_ = STATE_SKIP;
+                break;
+            }
+            params_[0][params_len_[0]++] = ch;
+            param0_digit_ = param0_digit_ && byte_class == CLASS_DIGIT;
+            state_ = STATE_PARAM0;
+            break;
+        case ACTION_PARAM1_BEGIN:
+            state_ = params_len_[0] > 0 ? STATE_PARAM1 : STATE_SKIP;
+            break;
+        case ACTION_PARAM1:
+            if (params_len_[1] == 2)
+            {
+                state_ = STATE_SKIP;
+                break;
+            }
+            params_[1][params_len_[1]++] = ch;
+            break;
+        case ACTION_ATTRIBUTE:
+            state_ = STATE_ATTRIBUTE;
+            break;
+        case ACTION_CURSOR:
+            state_ = params_len_[1] > 0 ? STATE_CURSOR : STATE_SKIP;
+            break;
+        default:
+            state_ = STATE_SKIP;
+            break;
+        }
+    }
+}
+
+void Vt100StateMachine::FinishPiece(bool segment_end)
+{
+    /*
+        Function Name   :FinishPiece()
+        Parameters      :segment_end: true if ESC ends the segment, false if the
+                         input of Consume() ends
+        Functionality   :report the Vt100Cmd of the current piece with the same
+                         rules as the regex engine: a bios draw segment must not
+                         break line in its first REGEX_MAX_STACK_COUNT chars, and
+                         a display attribute segment must not carry text.
+        Return          :None
+    */
+    if (state_ < STATE_ATTRIBUTE)
+    {
+        // keep the unfinished escape sequence for the next input
+        if (segment_end)
+            state_ = STATE_SKIP;
+        return;
+    }
+
+    bool body_empty = body_copied_ ? body_copy_.empty() : body_len_ == 0;
+    if (state_ == STATE_ATTRIBUTE)
+    {
+        if (!head_emitted_ && (body_empty || is_edk_shell_))
+        {
+            cmds_->push_back(Vt100Cmd(VT100_CMD_DISPLAY_ATTRIBUTES, ParamValue(params_[0], params_len_[0], NULL)));
+            head_emitted_ = true;
+        }
+        else if (!is_edk_shell_ && !body_empty)
+        {
+            state_ = STATE_SKIP;
+        }
+        if (is_edk_shell_)
+            EmitDraw();
+    }
+    else if (state_ == STATE_CURSOR)
+    {
+        if (!is_edk_shell_ && first_eol_ != -1 && first_eol_ < REGEX_MAX_STACK_COUNT)
+        {
+            state_ = STATE_SKIP;
+        }
+        else
+        {
+            if (!head_emitted_)
+            {
+                bool row_from_end = false;
+                bool col_from_end = false;
+                short row = ParamValue(params_[0], params_len_[0], &row_from_end);
+                short col = ParamValue(params_[1], params_len_[1], &col_from_end);
+                unsigned char flags = (row_from_end ? VT100_FLAG_ROW_FROM_END : 0) | (col_from_end ? VT100_FLAG_COL_FROM_END : 0);
+                cmds_->push_back(Vt100Cmd(VT100_CMD_CURSOR_POSITION, row, col, flags));
+                head_emitted_ = true;
+            }
+            EmitDraw();
+        }
+    }
+}
+
+void Vt100StateMachine::ReleaseClearPrefix()
+{
+    // the held bytes are a prefix of the clear screen sequence but the next
+    // byte does not match, pass them on except the longest tail which may
+    // still start the sequence
+    int keep = 0;
+    for (int i = 1; i < clear_pos_; i++)
+    {
+        if (memcmp(kClearHome + i, kClearHome, clear_pos_ - i) == 0)
+        {
+            keep = clear_pos_ - i;
+            break;
+        }
+    }
+    Tokenize(kClearHome, clear_pos_ - keep);
+    clear_pos_ = keep;
+}
+
+void Vt100StateMachine::ConsumeRun(const char *data, size_t len)
+{
+    // drop the clear screen sequence from a run of the stream and pass the
+    // rest to the tokenizer
+    size_t run_beg = 0;
+    size_t i = 0;
+    while (i < len)
+    {
+        if (clear_pos_ == 0)
+        {
+            const char *esc = (const char *)memchr(data + i, VT100_ESC_CHAR, len - i);
+            if (esc == NULL)
+                break;
+            i = esc - data;
+            Tokenize(data + run_beg, i - run_beg);
+            clear_pos_ = 1;
+            run_beg = ++i;
+        }
+        else if (data[i] == kClearHome[clear_pos_])
+        {
+            run_beg = ++i;
+            if (kClearHome[++clear_pos_] == '\0')
+                clear_pos_ = 0;
+        }
+        else
+        {
+            ReleaseClearPrefix();
+        }
+    }
+    Tokenize(data + run_beg, len - run_beg);
+}
+
+void Vt100StateMachine::Consume(const char *data, size_t len, const vector<ByteSpan> &runs, vector<Vt100Cmd> &cmds, string &payload)
+{
+    /*
+        Function Name   :Consume()
+        Parameters      :data, len: the serial data from serial port
+                         runs: the parts of the stream left by the noise
+                         filter, in data or kept by the filter
+                         cmds: the parsed Vt100Cmd are appended to it
+                         payload: the draw text which is not a part of
+                         data is appended to it
+        Functionality   :parse the serial data, an escape sequence cut at the end
+                         of data is finished by the next call. Text left
+                         after the end is drawn from where the last draw stopped.
+        Return          :None
+    */
+    cmds_ = &cmds;
+    payload_ = &payload;
+    input_ = data;
+    input_len_ = len;
+    for (auto it = runs.begin(); it != runs.end(); it++)
+        ConsumeRun((const char *)it->data_, it->size_);
+    FinishPiece(false);
+    if (state_ >= STATE_ATTRIBUTE)
+        BeginPiece();
+    cmds_ = NULL;
+    payload_ = NULL;
+    input_ = NULL;
+    input_len_ = 0;
+}
+
+NoiseFilter::NoiseFilter()
+{
+    /*
+        Function Name   :NoiseFilter()
+        Parameters      :None
+        Functionality   :a log printed into the serial data starts with one of
+                         the patterns and ends at the end of the line, or at the
+                         end of the line of its End pattern, or before the next
+                         ESC. All patterns are matched by one Aho-Corasick
+                         automaton, only the bytes which may still start a
+                         pattern are kept between two Filter() calls.
+        Return          :None
+    */
+    vector<NoiseFilterConfig> cfg_info(3);
+    cfg_info[0].Pattern = "EC Command:";
+    cfg_info[0].End = "Receiving EC Data:";
+    cfg_info[0].Mode = NOISE_FILTER_IN_BIOS | NOISE_FILTER_EC_OFF;
+    cfg_info[1].Pattern = "Receiving EC Data:";
+    cfg_info[1].Mode = NOISE_FILTER_IN_BIOS | NOISE_FILTER_EC_OFF;
+    cfg_info[2].Pattern = "FvbProtocolWrite:";
+    cfg_info[2].Mode = NOISE_FILTER_IN_BIOS;
+    SetConfig(cfg_info);
+}
+
+void NoiseFilter::SetConfig(const vector<NoiseFilterConfig> &cfg_info)
+{
+    cfg_info_.clear();
+    modes_ = 0;
+    for (auto it = cfg_info.begin(); it != cfg_info.end(); it++)
+    {
+        if (it->Pattern.empty())
+            continue;
+        modes_ |= it->Mode;
+        // a pattern given again is used in the modes of all its lines and
+        // counted once, the automaton keeps one pattern for each state
+        auto same = cfg_info_.begin();
+        while (same != cfg_info_.end() && same->Pattern != it->Pattern)
+            same++;
+        if (same != cfg_info_.end())
+        {
+            same->Mode |= it->Mode;
+            if (same->End.empty())
+                same->End = it->End;
+            continue;
+        }
+        cfg_info_.push_back(*it);
+        cfg_info_.back().Hits = 0;
+    }
+    Compile();
+    Reset();
+}
+
+bool NoiseFilter::LoadConfig(const string &file)
+{
+    /*
+        Function Name   :LoadConfig()
+        Parameters      :file: one pattern in a line, after the modes it is used in
+                         and a space, for example
+                             bios,ec_off EC Command:
+                         a log which goes on to the line of another pattern
+                         has both, with " ... " between them
+                             bios,ec_off EC Command: ... Receiving EC Data:
+                         the lines start with '#' are comments
+        Functionality   :replace the patterns by the ones in the file
+        Return          :false if the file can not be read
+    */
+    ifstream cfg_file(file.c_str());
+    if (!cfg_file.is_open())
+        return false;
+    vector<NoiseFilterConfig> cfg_info;
+    string line;
+    while (getline(cfg_file, line))
+    {
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.erase(line.size() - 1);
+        if (line.empty() || line[0] == '#')
+            continue;
+        string::size_type space = line.find(' ');
+        if (space == string::npos)
+        {
+            cout << "noise filter line \"" << line << "\" has no pattern" << endl;
+            continue;
+        }
+        NoiseFilterConfig cfg;
+        cfg.Pattern = line.substr(space + 1);
+        string::size_type end = cfg.Pattern.find(" ... ");
+        if (end != string::npos)
+        {
+            cfg.End = cfg.Pattern.substr(end + 5);
+            cfg.Pattern.erase(end);
+        }
+        cfg.Mode = 0;
+        cfg.Hits = 0;
+        vector<string> modes = strsplit(line.substr(0, space), ",");
+        for (auto it = modes.begin(); it != modes.end(); it++)
+        {
+            if (*it == "bios")
+                cfg.Mode |= NOISE_FILTER_IN_BIOS;
+            else if (*it == "ec_off")
+                cfg.Mode |= NOISE_FILTER_EC_OFF;
+            else
+                cout << "noise filter mode " << *it << " not support" << endl;
+        }
+        if (cfg.Mode != 0)
+            cfg_info.push_back(cfg);
+    }
+    SetConfig(cfg_info);
+    return true;
+}
+
+const vector<NoiseFilterConfig> &NoiseFilter::GetConfig()
+{
+    return cfg_info_;
+}
+
+int NoiseFilter::GetHits(const string &pattern)
+{
+    // the number of logs removed by the pattern, -1 if it is not configured
+    for (auto it = cfg_info_.begin(); it != cfg_info_.end(); it++)
+    {
+        if (it->Pattern == pattern)
+            return it->Hits;
+    }
+    return -1;
+}
+
+const string &NoiseFilter::GetHeld()
+{
+    // the bytes kept at the end of the last input, they may start a pattern
+    return held_;
+}
+
+void NoiseFilter::Compile()
+{
+    // build the trie of the patterns, then fill the missing transitions
+    // from the failure links in breadth first order. The End patterns which
+    // are not patterns are added after cfg_info_
+    vector<string> patterns;
+    end_.assign(cfg_info_.size(), -1);
+    for (size_t i = 0; i < cfg_info_.size(); i++)
+        patterns.push_back(cfg_info_[i].Pattern);
+    for (size_t i = 0; i < cfg_info_.size(); i++)
+    {
+        if (cfg_info_[i].End.empty())
+            continue;
+        end_[i] = find(patterns.begin(), patterns.end(), cfg_info_[i].End) - patterns.begin();
+        if (end_[i] == (int)patterns.size())
+            patterns.push_back(cfg_info_[i].End);
+    }
+    next_.assign(256, 0);
+    depth_.assign(1, 0);
+    output_.assign(1, -1);
+    out_link_.assign(1, -1);
+    for (int i = 0; i < (int)patterns.size(); i++)
+    {
+        int state = 0;
+        const string &pattern = patterns[i];
+        for (size_t j = 0; j < pattern.size(); j++)
+        {
+            int &next = next_[state * 256 + (unsigned char)pattern[j]];
+            if (next == 0)
+            {
+                next = (int)depth_.size();
+                next_.resize(next_.size() + 256, 0);
+                depth_.push_back(depth_[state] + 1);
+                output_.push_back(-1);
+                out_link_.push_back(-1);
+            }
+            state = next_[state * 256 + (unsigned char)pattern[j]];
+        }
+        output_[state] = i;
+    }
+
+    vector<int> fail(depth_.size(), 0);
+    vector<int> queue;
+    for (int ch = 0; ch < 256; ch++)
+    {
+        first_[ch] = next_[ch] != 0;
+        if (first_[ch])
+            queue.push_back(next_[ch]);
+    }
+    for (size_t head = 0; head < queue.size(); head++)
+    {
+        int state = queue[head];
+        for (int ch = 0; ch < 256; ch++)
+        {
+            int &next = next_[state * 256 + ch];
+            if (next != 0)
+            {
+                fail[next] = next_[fail[state] * 256 + ch];
+                out_link_[next] = output_[fail[next]] != -1 ? fail[next] : out_link_[fail[next]];
+                queue.push_back(next);
+            }
+            else
+            {
+                next = next_[fail[state] * 256 + ch];
+            }
+        }
+    }
+}
+
+void NoiseFilter::Reset()
+{
+    state_ = 0;
+    in_span_ = false;
+    span_end_ = -1;
+    held_.clear();
+    released_.clear();
+    runs_.clear();
+}
+
+int NoiseFilter::MatchPattern(unsigned char mode)
+{
+    // the pattern of the mode which ends at the current state, or -1
+    int state = output_[state_] != -1 ? state_ : out_link_[state_];
+    while (state != -1)
+    {
+        if (output_[state] < (int)cfg_info_.size() && (cfg_info_[output_[state]].Mode & mode))
+            return output_[state];
+        state = out_link_[state];
+    }
+    return -1;
+}
+
+bool NoiseFilter::MatchEnd(int end)
+{
+    // the End pattern ends at the current state or not
+    int state = output_[state_] != -1 ? state_ : out_link_[state_];
+    while (state != -1 && output_[state] != end)
+        state = out_link_[state];
+    return state != -1;
+}
+
+void NoiseFilter::AddRun(const char *data, long long beg, long long end)
+{
+    // the stream positions before 0 are the bytes kept from the last input
+    if (beg >= end)
+        return;
+    if (beg < 0)
+    {
+        long long held_end = end < 0 ? end : 0;
+        runs_.push_back(ByteSpan((const uint8_t *)released_.data() + released_.size() + beg, (size_t)(held_end - beg)));
+        beg = 0;
+    }
+    if (beg < end)
+        runs_.push_back(ByteSpan((const uint8_t *)data + beg, (size_t)(end - beg)));
+}
+
+const vector<ByteSpan> &NoiseFilter::Filter(const char *data, size_t len, bool in_bios, bool ec_off, bool end_of_input)
+{
+    /*
+        Function Name   :Filter()
+        Parameters      :data, len: the serial data from serial port
+                         in_bios: serial data get from bios or not
+                         ec_off: turn off ec related data or not
+                         end_of_input: no data follows, nothing is kept
+        Functionality   :remove the logs of the patterns used in the mode in one
+                         pass. A log may go on in the next input, and the end of
+                         data which may start a pattern is kept for the next call.
+        Return          :the parts of the stream left, valid until the next call
+    */
+    unsigned char mode = (in_bios ? NOISE_FILTER_IN_BIOS : 0) | (ec_off ? NOISE_FILTER_EC_OFF : 0);
+    runs_.clear();
+    released_.swap(held_);
+    held_.clear();
+    if ((mode & modes_) == 0)
+    {
+        state_ = 0;
+        in_span_ = false;
+        span_end_ = -1;
+        AddRun(data, -(long long)released_.size(), len);
+        return runs_;
+    }
+
+    long long run_beg = -(long long)released_.size();
+    size_t i = 0;
+    while (i < len)
+    {
+        if (in_span_)
+        {
+            // a log with an End goes on to the line of the End
+            while (i < len && data[i] != '\x1b' && (span_end_ != -1 || data[i] != '\n'))
+            {
+                if (span_end_ != -1)
+                {
+                    state_ = next_[state_ * 256 + (unsigned char)data[i]];
+                    if (MatchEnd(span_end_))
+                    {
+                        span_end_ = -1;
+                        state_ = 0;
+                    }
+                }
+                i++;
+            }
+            if (i == len)
+                break;
+            if (data[i] == '\n')
+                i++;
+            in_span_ = false;
+            span_end_ = -1;
+            state_ = 0;
+            run_beg = i;
+            continue;
+        }
+        if (state_ == 0)
+        {
+            while (i < len && !first_[(unsigned char)data[i]])
+                i++;
+            if (i == len)
+                break;
+        }
+        state_ = next_[state_ * 256 + (unsigned char)data[i++]];
+        if (output_[state_] == -1 && out_link_[state_] == -1)
+            continue;
+        int pattern = MatchPattern(mode);
+        if (pattern == -1)
+            continue;
+        cfg_info_[pattern].Hits++;
+        AddRun(data, run_beg, (long long)i - (long long)cfg_info_[pattern].Pattern.size());
+        state_ = 0;
+        in_span_ = true;
+        span_end_ = end_[pattern];
+    }
+    if (in_span_)
+        return runs_;
+    if (end_of_input)
+    {
+        // the bytes which may start a pattern are text
+        AddRun(data, run_beg, len);
+        state_ = 0;
+        return runs_;
+    }
+
+    // keep the bytes which may start a pattern
+    long long held_beg = (long long)len - depth_[state_];
+    AddRun(data, run_beg, held_beg);
+    if (held_beg < 0)
+        held_.assign(released_, released_.size() + held_beg, string::npos);
+    held_.append(data + (held_beg > 0 ? held_beg : 0), data + len);
+    return runs_;
 }
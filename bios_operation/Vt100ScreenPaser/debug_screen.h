@@ -5,6 +5,8 @@ Description : The header file of debug_screen.cpp
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <unordered_map>
 #include <iostream>
 #include <string>
@@ -12,15 +14,41 @@ Description : The header file of debug_screen.cpp
 #include <regex>
 
 #define DEFAULT_SERIAL_KEYWORDS_CONFIG_FILE "serial_keywords.ini"
+#define DEFAULT_NOISE_FILTER_CONFIG_FILE "noise_filter.ini"
 #define REGEX_MAX_STACK_COUNT 100 // the maximum length of string when regular matching
 
+#define SPLIT_ENGINE_REGEX 0         // split serial data by ESC and match every segment by regex
+#define SPLIT_ENGINE_STATE_MACHINE 1 // resumable byte-level VT100 state machine
+
+#define VT100_CMD_DISPLAY_ATTRIBUTES 0 // params_[0]: the display attribute
+#define VT100_CMD_CURSOR_POSITION 1    // params_[0], params_[1]: row and column, start from 1
+#define VT100_CMD_DRAW 2               // offset_, length_: the text to draw
+
+#define VT100_FLAG_ROW_FROM_END 0x01 // row is written as ":n", counts from the screen height
+#define VT100_FLAG_COL_FROM_END 0x02 // column is written as ":n", counts from the screen width
+#define VT100_FLAG_PAYLOAD 0x04      // text is in DebugScreen payload, not in the serial data
+
+#define NOISE_FILTER_IN_BIOS 0x01 // strip the log when the serial data is from bios
+#define NOISE_FILTER_EC_OFF 0x02  // strip the log when ec related data is turned off
+
 using namespace std;
 
 struct Vt100Cmd
 {
-    string description_;
-    vector<string> params_;
-    Vt100Cmd(string description, vector<string> values);
+    unsigned char op_;
+    unsigned char flags_;
+    short params_[2];
+    unsigned int offset_;
+    unsigned int length_;
+    Vt100Cmd(unsigned char op, short param0 = 0, short param1 = 0, unsigned char flags = 0);
+};
+
+struct ByteSpan
+{
+    const uint8_t *data_;
+    size_t size_;
+    ByteSpan(const uint8_t *data, size_t size);
+    ByteSpan(const string &str);
 };
 
 struct ParseConfig
@@ -28,21 +56,132 @@ struct ParseConfig
     string RegularExpression;
     string Description;
     string MarkChar;
+    unsigned char Op;
     regex RegPattern;
 };
 
+struct NoiseFilterConfig
+{
+    string Pattern;
+    string End; // the log goes on to the line of End, one line if it is empty
+    unsigned char Mode;
+    unsigned int Hits;
+};
+
 void Strcpy(char chs[], string str, int len);
 
+class NoiseFilter
+{
+private:
+    vector<NoiseFilterConfig> cfg_info_;
+    unsigned char modes_;
+
+    // Aho-Corasick automaton, next_ has 256 entries for each state
+    vector<int> next_;
+    vector<int> depth_;
+    vector<int> output_;
+    vector<int> out_link_;
+    vector<int> end_; // the automaton pattern of End of each pattern, -1 if none
+    bool first_[256];
+
+    int state_;
+    bool in_span_;
+    int span_end_; // the End the log goes on to, -1 for the end of the line
+    string held_;
+    string released_;
+    vector<ByteSpan> runs_;
+
+    void Compile();
+    int MatchPattern(unsigned char mode);
+    bool MatchEnd(int end);
+    void AddRun(const char *data, long long beg, long long end);
+
+public:
+    NoiseFilter();
+    void SetConfig(const vector<NoiseFilterConfig> &cfg_info);
+    bool LoadConfig(const string &file);
+    const vector<NoiseFilterConfig> &GetConfig();
+    int GetHits(const string &pattern);
+    const string &GetHeld();
+    void Reset();
+    const vector<ByteSpan> &Filter(const char *data, size_t len, bool in_bios, bool ec_off, bool end_of_input = false);
+};
+
+class Vt100StateMachine
+{
+private:
+    bool is_edk_shell_;
+    const char *input_;
+    size_t input_len_;
+    vector<Vt100Cmd> *cmds_;
+    string *payload_;
+
+    // clear screen sequence is dropped from the stream, as the regex engine does
+    int clear_pos_;
+
+    // state of the current segment, a segment is the bytes between two ESC
+    int state_;
+    int seg_pos_;
+    int first_eol_;
+    bool head_emitted_;
+    char params_[2][3];
+    int params_len_[2];
+    bool param0_digit_;
+    string head_;
+
+    // state at the beginning of the current piece, a piece is the part of
+    // a segment received in one Consume() call
+    int piece_state_;
+    int piece_seg_pos_;
+    int piece_first_eol_;
+    bool piece_head_emitted_;
+
+    const char *body_;
+    size_t body_len_;
+    bool body_copied_;
+    string body_copy_;
+
+    void Tokenize(const char *data, size_t len);
+    void ConsumeRun(const char *data, size_t len);
+    void ReleaseClearPrefix();
+    void BeginSegment();
+    void BeginPiece();
+    void AppendBody(const char *data, size_t len);
+    void FinishPiece(bool segment_end);
+    void EmitDraw();
+
+public:
+    Vt100StateMachine(bool is_edk_shell = false);
+    void Reset();
+    void Consume(const char *data, size_t len, const vector<ByteSpan> &runs, vector<Vt100Cmd> &cmds, string &payload);
+};
+
 class DebugScreen
 {
 private:
-    vector<Vt100Cmd> GetScreenInfo(string serial_data, bool in_bios, bool ec_off);
+    int engine_;
+    Vt100StateMachine state_machine_;
+    NoiseFilter noise_filter_;
+    string payload_;
+
+    void GetScreenInfo(string serial_data, vector<Vt100Cmd> &screen_info);
     vector<string> GetSegmentWordInfo(string markchars, string pattern_result);
 
 public:
-    DebugScreen(bool is_edk_shell = false);
+    DebugScreen(bool is_edk_shell = false, int engine = SPLIT_ENGINE_STATE_MACHINE);
     vector<ParseConfig> cfg_file_info_;
-    vector<Vt100Cmd> SerialOutputSplit(string serial_output, bool in_bios = true, bool ec_off = false);
+    void SetEngine(int engine);
+    int GetEngine();
+    bool LoadNoiseFilter(const string &file);
+    void SetNoiseFilter(const vector<NoiseFilterConfig> &cfg_info);
+    const vector<NoiseFilterConfig> &GetNoiseFilter();
+    int GetNoiseFilterHits(const string &pattern);
+    void Reset();
+    void SerialOutputSplit(const string &serial_output, vector<Vt100Cmd> &cmds, bool in_bios = true, bool ec_off = false, bool end_of_input = false);
+    void SerialOutputSplit(const char *data, size_t len, vector<Vt100Cmd> &cmds, bool in_bios = true, bool ec_off = false, bool end_of_input = false);
+    const string &SplitHeld(vector<Vt100Cmd> &cmds);
+    const char *GetText(const Vt100Cmd &cmd, const char *serial_output);
 };
 
 vector<string> strsplit(string input_str, string delim);
+short ParamValue(const char *param, size_t len, bool *from_end);
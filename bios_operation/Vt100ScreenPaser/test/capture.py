@@ -0,0 +1,171 @@
+"""
+File Name : capture.py
+Description : serial data of an EDK2 style setup browser for the tests, the
+              same seed gives the same frames
+"""
+
+import random
+
+ESC = b'\x1b'
+# width, height, value column, description column
+LAYOUT = {'client': (100, 31, 36, 70), 'server': (80, 25, 30, 57)}
+WORDS = ['Boot', 'Mode', 'Intel', 'Virtualization', 'Technology', 'Power', 'Config', 'TDP', 'Level',
+         'Memory', 'Frequency', 'PCIe', 'Slot', 'Link', 'Speed', 'Processor', 'Core', 'Turbo', 'Ratio',
+         'Limit', 'Package', 'C-State', 'Hyper-Threading', 'SATA', 'Controller', 'USB', 'Port',
+         'Security', 'Password', 'Secure', 'Network', 'Stack', 'IPv4', 'IPv6', 'Wake', 'On', 'LAN',
+         'Fan', 'Control', 'Thermal']
+KINDS = ['menu', 'drop', 'check', 'sub', 'dis', 'txt', 'drop2', 'input']
+
+
+def cursor(row, col):
+    # row and col start from 1
+    return ESC + b'[%02d;%02dH' % (row, col)
+
+
+def attributes(fg, bg, bold=False):
+    return ESC + b'[0m' + (ESC + b'[1m' if bold else b'') + ESC + b'[%dm' % bg + ESC + b'[%dm' % fg
+
+
+def phrase(rng, lo, hi):
+    return ' '.join(rng.choice(WORDS) for _ in range(rng.randint(lo, hi)))
+
+
+def box(out, row_beg, row_end, col_beg, col_end, fg, bg, title=None, up=False, down=False):
+    width = col_end - col_beg
+    top = b'\xda' + b'\xc4' * (width - 2) + b'\xbf'
+    bottom = b'\xc0' + b'\xc4' * (width - 2) + b'\xd9'
+    if up:
+        top = top[:width // 2] + b'\x18' + top[width // 2 + 1:]
+    if down:
+        bottom = bottom[:width // 2] + b'\x19' + bottom[width // 2 + 1:]
+    out.append(attributes(fg, bg) + cursor(row_beg + 1, col_beg + 1) + top)
+    for row in range(row_beg + 1, row_end - 1):
+        text = b' ' * (width - 2)
+        if title and row == row_beg + 1:
+            title_bytes = title.encode()[:width - 4]
+            pad = (width - 2 - len(title_bytes)) // 2
+            text = b' ' * pad + title_bytes + b' ' * (width - 2 - pad - len(title_bytes))
+        out.append(cursor(row + 1, col_beg + 1) + b'\xb3' + text + b'\xb3')
+    out.append(cursor(row_end, col_beg + 1) + bottom)
+
+
+def entry(row, kind, key, value, highlighted, value_col):
+    # an entry of the kind in KINDS at the row, from 0
+    if kind == 'menu':
+        key = '> ' + key
+    fg, bg = (37, 40) if highlighted else (34, 47)
+    if kind in ('sub', 'dis'):
+        fg, bg = 30, 47
+    out = attributes(fg, bg, kind == 'dis') + cursor(row + 1, 3) + key.encode()[:value_col - 4]
+    if value:
+        out += cursor(row + 1, value_col + 1) + value
+    return out
+
+
+def page(platform, entries, highlight, scroll_up=False, scroll_down=False, popups=()):
+    # a page of the (kind, key, value) entries, one row each, the entry highlight is highlighted.
+    # popups: (row_beg, row_end, col_beg, col_end, up, down) of the boxes drawn over the entries
+    width, height, value_col, desc_col = LAYOUT[platform]
+    out = [attributes(37, 44) + ESC + b'[2J' + cursor(1, 1)]
+    box(out, 0, 3, 0, width, 37, 44, title='Setup Page')
+    out.append(attributes(34, 47))
+    for row in range(3, height - 5):
+        out.append(cursor(row + 1, 1) + b' ' * width)
+    for i, (kind, key, value) in enumerate(entries):
+        out.append(entry(4 + i, kind, key, value, i == highlight, value_col))
+    if scroll_up:
+        out.append(attributes(31, 47) + cursor(4, width - 2) + b'\x18')
+    if scroll_down:
+        # on the last row of the workspace
+        out.append(attributes(31, 47) + cursor(height - 5, width - 2) + b'\x19')
+    for row_beg, row_end, col_beg, col_end, up, down in popups:
+        box(out, row_beg, row_end, col_beg, col_end, 37, 44, up=up, down=down)
+    box(out, height - 5, height, 0, width, 37, 40, title='Setup Utility')
+    out.append(attributes(37, 40) + cursor(height - 2, 3) + b'\x18\x19=Move Highlight  <Enter>=Select Entry  Esc=Exit')
+    return b''.join(out)
+
+
+def screen(rng, platform):
+    # a whole page: header, entries, description, scroll marks, a popup sometimes and footer
+    width, height, value_col, desc_col = LAYOUT[platform]
+    out = [attributes(37, 44) + ESC + b'[2J' + cursor(1, 1)]
+    box(out, 0, 3, 0, width, 37, 44, title=phrase(rng, 2, 4))
+    out.append(attributes(34, 47))
+    for row in range(3, height - 5):
+        out.append(cursor(row + 1, 1) + b' ' * width)
+    count = rng.randint(3, min(14, height - 10))
+    highlight = rng.randrange(count)
+    row = 4
+    for i in range(count):
+        if row >= height - 7:
+            break
+        kind = rng.choice(KINDS)
+        key = phrase(rng, 1, 3)
+        if i == highlight and kind in ('sub', 'dis'):
+            kind = 'drop'
+        value = b''
+        if kind in ('drop', 'drop2'):
+            value = ('<' + rng.choice(['Enabled', 'Disabled', 'Auto', 'Gen3']) + '>').encode()
+        elif kind == 'check':
+            value = rng.choice([b'[X]', b'[ ]'])
+        elif kind == 'input':
+            value = ('[' + str(rng.randint(0, 9999)) + ']').encode()
+        elif kind == 'dis':
+            value = b'Disabled'
+        out.append(entry(row, kind, key, value, i == highlight, value_col))
+        if kind == 'drop2' and row + 1 < height - 7:
+            # the key goes on in the next row
+            out.append(attributes(34, 47) + cursor(row + 2, 3) + rng.choice(WORDS).encode()[:10])
+            row += 1
+        row += 1
+    out.append(attributes(34, 47))
+    for i in range(rng.randint(1, 4)):
+        out.append(cursor(5 + i, desc_col + 1) + phrase(rng, 1, 3).encode()[:width - desc_col - 2])
+    if rng.random() < 0.3:
+        out.append(attributes(31, 47) + cursor(4, width - 2) + b'\x18')
+    if rng.random() < 0.3:
+        out.append(attributes(31, 47) + cursor(height - 6, width - 2) + b'\x19')
+    if rng.random() < 0.25:
+        popup_width = 30
+        popup_col = (width - popup_width) // 2
+        popup_row = 8
+        items = rng.randint(2, 5)
+        box(out, popup_row, popup_row + items + 2, popup_col, popup_col + popup_width, 37, 44)
+        popup_highlight = rng.randrange(items)
+        for i in range(items):
+            fg, bg = (37, 46) if i == popup_highlight else (37, 44)
+            out.append(attributes(fg, bg) + cursor(popup_row + 2 + i, popup_col + 2) +
+                       rng.choice(WORDS).encode().ljust(popup_width - 2))
+    box(out, height - 5, height, 0, width, 37, 40, title=phrase(rng, 3, 6))
+    out.append(attributes(37, 40) + cursor(height - 2, 3) + b'\x18\x19=Move Highlight  <Enter>=Select Entry  Esc=Exit')
+    return b''.join(out)
+
+
+def repaint(rng, platform):
+    # a keystroke: a few rows of the page are drawn again
+    width, height, value_col, desc_col = LAYOUT[platform]
+    out = []
+    for _ in range(rng.randint(1, 3)):
+        row = rng.randint(5, height - 8)
+        fg, bg = rng.choice([(37, 40), (34, 47)])
+        out.append(attributes(fg, bg) + cursor(row, 3) + phrase(rng, 1, 2).encode()[:value_col - 4])
+        if rng.random() < 0.5:
+            out.append(cursor(row, value_col + 1) + rng.choice([b'[X]', b'[ ]', b'<Enabled>']))
+    return b''.join(out)
+
+
+def frames(seed, platform, screens):
+    # the data of each poll, every page is followed by up to 4 keystrokes
+    rng = random.Random(seed)
+    result = []
+    for _ in range(screens):
+        result.append(screen(rng, platform))
+        for _ in range(rng.randint(0, 4)):
+            result.append(repaint(rng, platform))
+    return result
+
+
+if __name__ == '__main__':
+    # capture.py <seed> <client|server> <pages> > capture.bin, a capture for bench/vt100_bench
+    import sys
+    sys.stdout.buffer.write(b''.join(frames(int(sys.argv[1]), sys.argv[2], int(sys.argv[3]))))
@@ -0,0 +1,118 @@
+"""
+File Name : test_find_keys.py
+Description : FindKeys() on the pages of a replayed capture
+"""
+
+import ctypes
+import random
+import unittest
+
+import capture
+import vt100_lib
+
+lib = vt100_lib.load()
+
+KEY_CANDIDATE_INTS = 2
+
+
+def trigrams(key):
+    # the letters and the digits of the upper-cased key, padded at both ends
+    chars = [ch for ch in key.upper() if chr(ch).isascii() and chr(ch).isalnum()]
+    if not chars:
+        return set()
+    padded = [1, 1] + chars + [2]
+    return set(tuple(padded[i:i + 3]) for i in range(len(padded) - 2))
+
+
+def find_keys(handle, key, min_score, size=100):
+    candidates = (ctypes.c_int * (size * KEY_CANDIDATE_INTS))()
+    count = lib.Vt100FindKeys(handle, key, min_score, candidates, size * KEY_CANDIDATE_INTS)
+    return count, [tuple(candidates[i * KEY_CANDIDATE_INTS:(i + 1) * KEY_CANDIDATE_INTS]) for i in range(min(count, size))]
+
+
+def feed_page(handle):
+    # a page with some entries and without a popup, FindKeys() skips the popups
+    for frame in capture.frames(19, 'client', 10):
+        if b'\x1b[2J' not in frame:
+            continue
+        lib.Vt100Feed(handle, frame)
+        entries = vt100_lib.page_entries(lib, handle, 0)
+        if len(entries) >= 5 and not lib.Vt100GetSelectPage(handle).contents.is_popup:
+            return entries
+    raise AssertionError('no page for FindKeys()')
+
+
+class FindKeysTest(unittest.TestCase):
+    def setUp(self):
+        self.handle = lib.Vt100Create(b'client')
+
+    def tearDown(self):
+        lib.Vt100Destroy(self.handle)
+
+    def test_scores_are_dice_of_trigrams(self):
+        rng = random.Random(19)
+        queries = 0
+        for frame in capture.frames(19, 'client', 30):
+            lib.Vt100Feed(self.handle, frame)
+            entries = vt100_lib.page_entries(lib, self.handle, 0)
+            if not entries or lib.Vt100GetSelectPage(self.handle).contents.is_popup:
+                continue
+            entry_trigrams = [trigrams(key.strip()) for key, value, entry_type in entries]
+            for _ in range(5):
+                key = rng.choice(entries)[0].strip()
+                change = rng.randint(0, 3)
+                if change == 1 and len(key) > 4:
+                    cut = rng.randrange(1, len(key))
+                    key = key[:cut] + b' ' + key[cut:]
+                elif change == 2 and len(key) > 6:
+                    key = key[:rng.randint(len(key) // 2, len(key) - 1)]
+                elif change == 3:
+                    key = key.lower()
+                min_score = rng.choice([0, 0, 30, 60])
+                key_trigrams = trigrams(key)
+                expected = []
+                for i, found in enumerate(entry_trigrams):
+                    shared = len(key_trigrams & found)
+                    score = 200 * shared // (len(key_trigrams) + len(found)) if shared else 0
+                    if shared and score >= min_score:
+                        expected.append((i, score))
+                expected.sort(key=lambda candidate: (-candidate[1], candidate[0]))
+                self.assertEqual(find_keys(self.handle, key, min_score), (len(expected), expected), key)
+                queries += 1
+        self.assertGreater(queries, 50)
+
+    def test_wrapped_key_is_found_first(self):
+        entries = feed_page(self.handle)
+        for key, value, entry_type in entries:
+            key = key.strip()
+            same = [i for i, entry in enumerate(entries) if entry[0].strip().upper() == key.upper()]
+            for variant in (key.lower(), key[:len(key) // 2] + b' ' + key[len(key) // 2:], key.replace(b' ', b'')):
+                count, candidates = find_keys(self.handle, variant, 0)
+                self.assertIn(candidates[0][0], same, variant)
+                self.assertEqual(candidates[0][1], 100, variant)
+
+    def test_popup_page_has_no_candidates(self):
+        for frame in capture.frames(19, 'client', 30):
+            lib.Vt100Feed(self.handle, frame)
+            if lib.Vt100GetSelectPage(self.handle).contents.is_popup:
+                self.assertEqual(find_keys(self.handle, b'Boot', 0)[0], 0)
+                return
+        self.fail('no popup page')
+
+    def test_candidates_beyond_size_are_counted(self):
+        entries = feed_page(self.handle)
+        key = b' '.join(entry[0] for entry in entries)
+        count, candidates = find_keys(self.handle, key, 0)
+        self.assertGreater(count, 1)
+        buf = (ctypes.c_int * (KEY_CANDIDATE_INTS + 1))(-7, -7, -7)
+        self.assertEqual(lib.Vt100FindKeys(self.handle, key, 0, buf, KEY_CANDIDATE_INTS + 1), count)
+        self.assertEqual(list(buf), list(candidates[0]) + [-7])
+
+    def test_no_key(self):
+        self.assertEqual(lib.Vt100FindKeys(self.handle, None, 0, None, 0), -1)
+        feed_page(self.handle)
+        self.assertEqual(find_keys(self.handle, b'-- ', 0)[0], 0)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,90 @@
+"""
+File Name : test_find_text.py
+Description : FindText() on the screens of a replayed capture
+"""
+
+import ctypes
+import random
+import unittest
+
+import capture
+import vt100_lib
+from vt100_lib import TextQuery
+
+lib = vt100_lib.load()
+
+TEXT_HIT_INTS = 5
+
+
+def find_text(handle, query, size=1000):
+    hits = (ctypes.c_int * (size * TEXT_HIT_INTS))()
+    count = lib.Vt100FindText(handle, ctypes.byref(query), hits, size * TEXT_HIT_INTS)
+    return count, [tuple(hits[i * TEXT_HIT_INTS:(i + 1) * TEXT_HIT_INTS]) for i in range(min(count, size))]
+
+
+class FindTextTest(unittest.TestCase):
+    def setUp(self):
+        self.handle = lib.Vt100Create(b'client')
+
+    def tearDown(self):
+        lib.Vt100Destroy(self.handle)
+
+    def test_hits_are_every_position(self):
+        rng = random.Random(18)
+        total_hits = 0
+        for frame in capture.frames(18, 'client', 12):
+            lib.Vt100Feed(self.handle, frame)
+            rows, attrs = vt100_lib.screen_cells(lib, self.handle)
+            height = len(rows)
+            width = len(rows[0])
+            for _ in range(20):
+                row = rng.randrange(height)
+                col = rng.randrange(width)
+                pattern = rows[row][col:col + rng.choice([1, 2, 3, 5, 8])]
+                if rng.random() < 0.2:
+                    pattern = rng.choice([b'  ', b'ab', b'XYZ', b'\xc4\xc4', b'==='])
+                ignore_case = rng.randint(0, 1)
+                if ignore_case and rng.random() < 0.5:
+                    pattern = pattern.swapcase()
+                row_beg = rng.choice([0, 0, rng.randrange(height)])
+                row_end = rng.choice([-1, -1, rng.randrange(height + 3)])
+                col_beg = rng.choice([0, 0, rng.randrange(width)])
+                col_end = rng.choice([-1, -1, rng.randrange(width + 3)])
+                fg, bg, text = attrs[row][col]
+                fg = rng.choice([-1, -1, fg])
+                bg = rng.choice([-1, -1, bg])
+                text = rng.choice([-1, -1, text])
+
+                expected = []
+                upper = pattern.upper() if ignore_case else pattern
+                for hit_row in range(max(row_beg, 0), min(row_end if row_end >= 0 else height, height)):
+                    for hit_col in range(max(col_beg, 0), min(col_end if col_end >= 0 else width, width) - len(pattern) + 1):
+                        cells = rows[hit_row][hit_col:hit_col + len(pattern)]
+                        if (cells.upper() if ignore_case else cells) != upper:
+                            continue
+                        if any((fg >= 0 and attr[0] != fg) or (bg >= 0 and attr[1] != bg) or (text >= 0 and attr[2] != text)
+                               for attr in attrs[hit_row][hit_col:hit_col + len(pattern)]):
+                            continue
+                        expected.append((hit_row, hit_col) + attrs[hit_row][hit_col])
+                query = TextQuery(pattern, ignore_case, row_beg, row_end, col_beg, col_end, fg, bg, text)
+                self.assertEqual(find_text(self.handle, query), (len(expected), expected[:1000]), query.pattern)
+                total_hits += len(expected)
+        self.assertGreater(total_hits, 0)
+
+    def test_hits_beyond_size_are_counted(self):
+        lib.Vt100Feed(self.handle, capture.frames(18, 'client', 1)[0])
+        query = TextQuery(b' ', 0, 0, -1, 0, -1, -1, -1, -1)
+        count, hits = find_text(self.handle, query, 4000)
+        self.assertGreater(count, 2)
+        buf = (ctypes.c_int * (2 * TEXT_HIT_INTS + 1))(*([-7] * (2 * TEXT_HIT_INTS + 1)))
+        # a hit is written only if all its ints fit
+        self.assertEqual(lib.Vt100FindText(self.handle, ctypes.byref(query), buf, 2 * TEXT_HIT_INTS + 1), count)
+        self.assertEqual(list(buf), list(hits[0] + hits[1]) + [-7])
+
+    def test_empty_text(self):
+        query = TextQuery(b'', 0, 0, -1, 0, -1, -1, -1, -1)
+        self.assertEqual(lib.Vt100FindText(self.handle, ctypes.byref(query), None, 0), -1)
+
+
+if __name__ == '__main__':
+    unittest.main()
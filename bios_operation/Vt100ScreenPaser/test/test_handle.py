@@ -0,0 +1,118 @@
+"""
+File Name : test_handle.py
+Description : the handles are parsed independently and the exports without a
+              handle are safe in parallel threads
+"""
+
+import threading
+import unittest
+
+import capture
+import vt100_lib
+
+lib = vt100_lib.load()
+
+
+def select_pages(platform, frames):
+    # the page after each frame, parsed by a handle of its own
+    handle = lib.Vt100Create(platform)
+    pages = []
+    for frame in frames:
+        lib.Vt100Feed(handle, frame)
+        pages.append(lib.Vt100GetSelectPage(handle).contents.values())
+    lib.Vt100Destroy(handle)
+    return pages
+
+
+class HandleTest(unittest.TestCase):
+    def test_handles_are_independent(self):
+        client_frames = capture.frames(1, 'client', 20)
+        server_frames = capture.frames(2, 'server', 20)
+        client = lib.Vt100Create(b'client')
+        server = lib.Vt100Create(b'server')
+        client_pages = []
+        server_pages = []
+        for i in range(max(len(client_frames), len(server_frames))):
+            if i < len(client_frames):
+                lib.Vt100Feed(client, client_frames[i])
+                client_pages.append(lib.Vt100GetSelectPage(client).contents.values())
+            if i < len(server_frames):
+                lib.Vt100Feed(server, server_frames[i])
+                server_pages.append(lib.Vt100GetSelectPage(server).contents.values())
+        lib.Vt100Destroy(client)
+        lib.Vt100Destroy(server)
+        self.assertEqual(client_pages, select_pages(b'client', client_frames))
+        self.assertEqual(server_pages, select_pages(b'server', server_frames))
+
+    def test_legacy_results_are_copied_whole(self):
+        # two pages are fed in turn while other threads copy the results of
+        # Init(), every copy is one of the two pages
+        frames = [frame for frame in capture.frames(3, 'client', 8) if b'\x1b[2J' in frame][:2]
+        pages = select_pages(b'client', frames)
+        wholes = []
+        for frame in frames:
+            handle = lib.Vt100Create(b'client')
+            lib.Vt100Feed(handle, frame)
+            wholes.append(lib.Vt100GetWholePage(handle).contents.rows())
+            lib.Vt100Destroy(handle)
+        self.assertNotEqual(pages[0], pages[1])
+
+        lib.Init(b'client')
+        lib.Feed(frames[0])
+        stop = threading.Event()
+        errors = []
+
+        def feed():
+            for i in range(2000):
+                lib.Feed(frames[i % 2])
+            stop.set()
+
+        def copy():
+            while not stop.is_set():
+                page = lib.GetSelectPage().values()
+                if page not in pages:
+                    errors.append(page)
+                rows = lib.GetWholePage().rows()
+                if rows not in wholes:
+                    errors.append(rows)
+
+        threads = [threading.Thread(target=feed)] + [threading.Thread(target=copy) for _ in range(4)]
+        for thread in threads:
+            thread.start()
+        for thread in threads:
+            thread.join()
+        self.assertEqual(errors[:1], [])
+
+    def test_init_again_while_other_threads_call(self):
+        # Init() makes a new parser in the same handle, the calls running in
+        # other threads are not left with a freed handle
+        frames = capture.frames(4, 'client', 6)
+        lib.Init(b'client')
+        stop = threading.Event()
+
+        def call():
+            i = 0
+            while not stop.is_set():
+                lib.Feed(frames[i % len(frames)])
+                lib.GetSelectPage()
+                lib.GetWholePage()
+                i += 1
+
+        threads = [threading.Thread(target=call) for _ in range(3)]
+        for thread in threads:
+            thread.start()
+        for i in range(200):
+            lib.Init(b'client')
+        stop.set()
+        for thread in threads:
+            thread.join()
+
+        # the screen of the new parser is clean
+        lib.Init(b'client')
+        handle = lib.Vt100Create(b'client')
+        self.assertEqual(lib.GetWholePage().rows(), lib.Vt100GetWholePage(handle).contents.rows())
+        lib.Vt100Destroy(handle)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,144 @@
+"""
+File Name : test_noise_filter.py
+Description : the logs of the configured noise filter patterns are removed
+"""
+
+import os
+import random
+import shutil
+import tempfile
+import unittest
+
+import capture
+import vt100_lib
+
+lib = vt100_lib.load()
+
+EDK_SHELL_OUTPUT = b'\x1b[0mShell> ls\r\nMyDriver: noisy line\r\nfile.txt\r\n'
+
+
+class NoiseFilterTest(unittest.TestCase):
+    def setUp(self):
+        self.dir = tempfile.mkdtemp()
+        self.handle = lib.Vt100Create(b'client')
+
+    def tearDown(self):
+        lib.Vt100Destroy(self.handle)
+        shutil.rmtree(self.dir)
+
+    def config(self, text):
+        path = os.path.join(self.dir, 'noise_filter.ini')
+        with open(path, 'w') as cfg_file:
+            cfg_file.write(text)
+        return path.encode()
+
+    def test_edk_shell_uses_configured_pattern(self):
+        self.assertTrue(lib.Vt100LoadNoiseFilter(self.handle, self.config('ec_off MyDriver\n')))
+        self.assertEqual(lib.Vt100ParseEdkShell(self.handle, EDK_SHELL_OUTPUT, True), b'Shell> ls\r\nfile.txt\r\n')
+        self.assertEqual(lib.Vt100GetNoiseFilterHits(self.handle, b'MyDriver'), 1)
+        # ec_off patterns are kept when the ec logs are not removed
+        self.assertEqual(lib.Vt100ParseEdkShell(self.handle, EDK_SHELL_OUTPUT, False), EDK_SHELL_OUTPUT[4:])
+        self.assertEqual(lib.Vt100GetNoiseFilterHits(self.handle, b'MyDriver'), 1)
+
+    def test_edk_shell_of_init_uses_configured_pattern(self):
+        lib.Init(b'client')
+        self.assertTrue(lib.LoadNoiseFilter(self.config('ec_off MyDriver\n')))
+        self.assertEqual(lib.ParseEdkShell(EDK_SHELL_OUTPUT, True), b'Shell> ls\r\nfile.txt\r\n')
+        self.assertEqual(lib.GetNoiseFilterHits(b'MyDriver'), 1)
+
+    def test_edk_shell_calls_are_independent(self):
+        # a log cut at the end of one call is not continued by the next call
+        self.assertTrue(lib.Vt100LoadNoiseFilter(self.handle, self.config('ec_off MyDriver\n')))
+        lib.Vt100ParseEdkShell(self.handle, b'\x1b[0mA MyDri', True)
+        self.assertEqual(lib.Vt100ParseEdkShell(self.handle, b'\x1b[0mver x\r\n', True), b'ver x\r\n')
+
+    def test_edk_shell_end_which_may_start_a_pattern_is_text(self):
+        # the output is parsed whole, nothing is kept for a next call
+        for text in (b'Shell> echo DONE', b'Shell> echo Rec', b'Shell> echo F'):
+            self.assertEqual(lib.Vt100ParseEdkShell(self.handle, b'\x1b[0m' + text, True), text)
+            self.assertEqual(lib.ParseEdkShell(b'\x1b[0m' + text, True), text)
+
+    def test_check_draw_end_which_may_start_a_pattern_is_text(self):
+        for text in (b'E', b'R', b'F', b'SAVE', b'EC Comm'):
+            self.assertTrue(lib.CheckVt100Draw(b'\x1b[01;01H' + text))
+        self.assertFalse(lib.CheckVt100Draw(b'\x1b[01;01HEC Command: 1'))
+
+    def test_feed_end_which_may_start_a_pattern_is_drawn(self):
+        lib.Vt100Feed(self.handle, b'\x1b[01;01HSAVE')
+        self.assertEqual(self.row(0), b'SAVE')
+        # taken back when the next input makes it a log
+        lib.Vt100Feed(self.handle, b'C Command: 1\r\n')
+        self.assertEqual(self.row(0), b'SAV')
+        self.assertEqual(lib.Vt100GetNoiseFilterHits(self.handle, b'EC Command:'), 1)
+        lib.Vt100Feed(self.handle, b'\x1b[02;01HRE')
+        self.assertEqual(self.row(1), b'RE')
+        lib.Vt100Feed(self.handle, b'AD\x1b[03;01HX')
+        self.assertEqual([self.row(1), self.row(2)], [b'READ', b'X'])
+
+    def test_feed_end_is_kept_when_the_patterns_are_loaded(self):
+        lib.Vt100Feed(self.handle, b'\x1b[01;01HFv')
+        self.assertTrue(lib.Vt100LoadNoiseFilter(self.handle, self.config('bios MyDriver\n')))
+        lib.Vt100Feed(self.handle, b'bProtocolWrite: x')
+        self.assertEqual(self.row(0), b'FvbProtocolWrite: x')
+
+    def test_chunked_feed_is_the_screen_of_the_data(self):
+        # every chunk of a capture shows the screen of all the data fed, as
+        # a parser without patterns which keeps no bytes
+        whole = lib.Vt100Create(b'client')
+        self.assertTrue(lib.Vt100LoadNoiseFilter(whole, self.config('# no pattern\n')))
+        data = b''.join(capture.frames(5, 'client', 4))
+        rng = random.Random(5)
+        pos = 0
+        while pos < len(data):
+            chunk = data[pos:pos + rng.randrange(1, 9)]
+            pos += len(chunk)
+            lib.Vt100FeedBytes(self.handle, chunk, len(chunk))
+            lib.Vt100FeedBytes(whole, chunk, len(chunk))
+            if chunk[-1:] in b'ERF' or rng.random() < 0.05:
+                self.assertEqual(lib.Vt100GetWholePage(self.handle).contents.rows(),
+                                 lib.Vt100GetWholePage(whole).contents.rows())
+        lib.Vt100Destroy(whole)
+
+    def row(self, row):
+        return lib.Vt100GetWholePage(self.handle).contents.rows()[row].rstrip(b' \x00')
+
+    def test_ec_command_goes_on_to_receiving_ec_data(self):
+        output = b'\x1b[0mEC Command: 1\r\nhello\r\nReceiving EC Data: 2\r\nbye'
+        self.assertEqual(lib.Vt100ParseEdkShell(self.handle, output, True), b'bye')
+        self.assertEqual(lib.Vt100ParseEdkShell(self.handle, output, False), output[4:])
+        # a log without its End ends before the next ESC
+        output = b'\x1b[0mEC Command: 1\r\nhello\r\n\x1b[0mbye'
+        self.assertEqual(lib.Vt100ParseEdkShell(self.handle, output, True), b'bye')
+        self.assertEqual(lib.Vt100ParseEdkShell(self.handle, b'\x1b[0mReceiving EC Data: 2\r\nbye', True), b'bye')
+
+    def test_feed_log_goes_on_to_its_end_in_the_next_input(self):
+        lib.Vt100Feed(self.handle, b'\x1b[01;01HSetup EC Command: 1\r\nhello\r\nReceiving EC')
+        lib.Vt100Feed(self.handle, b' Data: 2\r\nPage\x1b[02;01HBoot')
+        self.assertEqual([self.row(0), self.row(1)], [b'Setup Page', b'Boot'])
+        self.assertEqual(lib.Vt100GetNoiseFilterHits(self.handle, b'EC Command:'), 1)
+        self.assertEqual(lib.Vt100GetNoiseFilterHits(self.handle, b'Receiving EC Data:'), 0)
+
+    def test_configured_end(self):
+        self.assertTrue(lib.Vt100LoadNoiseFilter(self.handle, self.config('ec_off MyDriver: ... done.\n')))
+        output = b'\x1b[0mMyDriver: start\r\nstep\r\ndone.\r\nfile.txt\r\n'
+        self.assertEqual(lib.Vt100ParseEdkShell(self.handle, output, True), b'file.txt\r\n')
+        self.assertEqual(lib.Vt100GetNoiseFilterHits(self.handle, b'MyDriver:'), 1)
+        self.assertEqual(lib.Vt100GetNoiseFilterHits(self.handle, b'done.'), -1)
+        # the End alone is text
+        self.assertEqual(lib.Vt100ParseEdkShell(self.handle, b'\x1b[0mdone.\r\n', True), b'done.\r\n')
+
+    def test_duplicate_pattern_is_used_in_both_modes(self):
+        self.assertTrue(lib.Vt100LoadNoiseFilter(self.handle, self.config('bios MyDriver\nec_off MyDriver\n')))
+        self.assertEqual(lib.Vt100ParseEdkShell(self.handle, EDK_SHELL_OUTPUT, True), b'Shell> ls\r\nfile.txt\r\n')
+        lib.Vt100Feed(self.handle, b'\x1b[01;01HMyDriver: noisy line\r\n\x1b[02;01HSetup')
+        self.assertEqual(lib.Vt100GetNoiseFilterHits(self.handle, b'MyDriver'), 2)
+
+    def test_feed_uses_configured_pattern(self):
+        self.assertTrue(lib.Vt100LoadNoiseFilter(self.handle, self.config('bios MyDriver\n')))
+        lib.Vt100Feed(self.handle, b'\x1b[01;01HMyDriver: noisy line\r\n\x1b[02;01HSetup')
+        self.assertEqual(lib.Vt100GetNoiseFilterHits(self.handle, b'MyDriver'), 1)
+        self.assertEqual(lib.Vt100GetNoiseFilterHits(self.handle, b'Unknown'), -1)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,155 @@
+"""
+File Name : test_page_record.py
+Description : GetPageRecord() in JSON and MessagePack against GetSelectPage() on a replayed capture
+"""
+
+import ctypes
+import json
+import struct
+import unittest
+
+import capture
+import vt100_lib
+
+lib = vt100_lib.load()
+
+PAGE_RECORD_JSON = 0
+PAGE_RECORD_MSGPACK = 1
+PAGE_RECORD_ROWS = 0x01
+
+
+def msgpack_loads(data):
+    # the MessagePack types written by the record: int, bool, str, array and map
+    def value(pos):
+        code = data[pos]
+        pos += 1
+        if code < 0x80:
+            return code, pos
+        if code >= 0xe0:
+            return code - 0x100, pos
+        if code in (0xc2, 0xc3):
+            return code == 0xc3, pos
+        if code == 0xd2:
+            return struct.unpack_from('>i', data, pos)[0], pos + 4
+        if 0xa0 <= code < 0xc0 or code in (0xd9, 0xda, 0xdb):
+            if code < 0xc0:
+                size = code & 0x1f
+            else:
+                width = {0xd9: 1, 0xda: 2, 0xdb: 4}[code]
+                size = int.from_bytes(data[pos:pos + width], 'big')
+                pos += width
+            return data[pos:pos + size].decode('utf-8'), pos + size
+        if 0x80 <= code < 0xa0 or code in (0xdc, 0xdd, 0xde, 0xdf):
+            if code < 0xa0:
+                count = code & 0x0f
+                is_map = code < 0x90
+            else:
+                width = 2 if code in (0xdc, 0xde) else 4
+                count = int.from_bytes(data[pos:pos + width], 'big')
+                pos += width
+                is_map = code in (0xde, 0xdf)
+            items = []
+            for _ in range(count * 2 if is_map else count):
+                item, pos = value(pos)
+                items.append(item)
+            return (dict(zip(items[::2], items[1::2])) if is_map else items), pos
+        raise ValueError('unexpected MessagePack code 0x%02x' % code)
+
+    result, pos = value(0)
+    assert pos == len(data)
+    return result
+
+
+def loads(record, format):
+    # the texts are the bytes of the screen as the chars U+0000 - U+00FF
+    if format == PAGE_RECORD_JSON:
+        return json.loads(record.decode('utf-8'))
+    return msgpack_loads(record)
+
+
+def page_record(handle, format, flags):
+    size = lib.Vt100GetPageRecord(handle, format, flags, None, 0)
+    buf = ctypes.create_string_buffer(size)
+    assert lib.Vt100GetPageRecord(handle, format, flags, buf, size) == size
+    return buf.raw
+
+
+def expected_record(handle, with_rows):
+    titles, description, highlight_idx, up, down, dialog, popup, _ = \
+        lib.Vt100GetSelectPage(handle).contents.values()
+    record = {'titles': titles.decode('latin-1'), 'description': description.decode('latin-1'),
+              'highlight_idx': highlight_idx, 'is_scrollable_up': up, 'is_scrollable_down': down,
+              'is_dialog_box': dialog, 'is_popup': popup,
+              'entries': [[key.decode('latin-1'), value.decode('latin-1'), entry_type]
+                          for key, value, entry_type in vt100_lib.page_entries(lib, handle, 1)]}
+    if with_rows:
+        record['rows'] = [row.decode('latin-1') for row in vt100_lib.screen_cells(lib, handle)[0]]
+    return record
+
+
+class PageRecordTest(unittest.TestCase):
+    def setUp(self):
+        self.handle = lib.Vt100Create(b'client')
+
+    def tearDown(self):
+        lib.Vt100Destroy(self.handle)
+
+    def test_record_is_select_page(self):
+        for frame in capture.frames(25, 'client', 20):
+            lib.Vt100Feed(self.handle, frame)
+            for format in (PAGE_RECORD_JSON, PAGE_RECORD_MSGPACK):
+                for flags in (0, PAGE_RECORD_ROWS):
+                    record = loads(page_record(self.handle, format, flags), format)
+                    self.assertEqual(record, expected_record(self.handle, flags & PAGE_RECORD_ROWS))
+
+    def test_texts_are_escaped(self):
+        entries = [('input', 'Path "A\\B"', b'[\xb0C]'), ('txt', 'Build Date', b'10/17')]
+        lib.Vt100Feed(self.handle, capture.page('client', entries, 0))
+        for format in (PAGE_RECORD_JSON, PAGE_RECORD_MSGPACK):
+            record = loads(page_record(self.handle, format, 0), format)
+            self.assertEqual(record['entries'][0][:2], ['Path "A\\B"', '[\xb0C]'])
+            self.assertEqual(record, expected_record(self.handle, False))
+
+    def test_short_buffer_is_not_written(self):
+        lib.Vt100Feed(self.handle, capture.frames(25, 'client', 1)[0])
+        for format in (PAGE_RECORD_JSON, PAGE_RECORD_MSGPACK):
+            size = lib.Vt100GetPageRecord(self.handle, format, PAGE_RECORD_ROWS, None, 0)
+            buf = ctypes.create_string_buffer(b'\xf9' * size, size)
+            self.assertEqual(lib.Vt100GetPageRecord(self.handle, format, PAGE_RECORD_ROWS, buf, size - 1), size)
+            self.assertEqual(buf.raw, b'\xf9' * size)
+
+    def test_invalid_format(self):
+        lib.Vt100Feed(self.handle, capture.frames(25, 'client', 1)[0])
+        buf = ctypes.create_string_buffer(64)
+        self.assertEqual(lib.Vt100GetPageRecord(self.handle, 2, 0, buf, 64), -1)
+        self.assertEqual(lib.Vt100GetPageRecord(self.handle, -1, 0, None, 0), -1)
+        size = ctypes.c_int(-7)
+        self.assertFalse(lib.Vt100GetPageRecordBuffer(self.handle, 2, 0, ctypes.byref(size)))
+        self.assertEqual(size.value, 0)
+
+    def test_buffer_is_made_again_after_a_change(self):
+        # the record is cached, it must follow Feed() and CleanScreenData()
+        size = ctypes.c_int()
+        for frame in capture.frames(25, 'client', 10):
+            lib.Vt100Feed(self.handle, frame)
+            for format in (PAGE_RECORD_JSON, PAGE_RECORD_MSGPACK, PAGE_RECORD_JSON):
+                buf = lib.Vt100GetPageRecordBuffer(self.handle, format, PAGE_RECORD_ROWS, ctypes.byref(size))
+                self.assertEqual(buf[:size.value], page_record(self.handle, format, PAGE_RECORD_ROWS))
+                self.assertEqual(loads(buf[:size.value], format), expected_record(self.handle, True))
+        lib.Vt100CleanScreenData(self.handle)
+        buf = lib.Vt100GetPageRecordBuffer(self.handle, PAGE_RECORD_JSON, PAGE_RECORD_ROWS, ctypes.byref(size))
+        self.assertEqual(loads(buf[:size.value], PAGE_RECORD_JSON), expected_record(self.handle, True))
+
+    def test_without_handle(self):
+        frame = capture.frames(25, 'client', 1)[0]
+        lib.Init(b'client')
+        lib.Feed(frame)
+        lib.Vt100Feed(self.handle, frame)
+        expected = page_record(self.handle, PAGE_RECORD_MSGPACK, PAGE_RECORD_ROWS)
+        buf = ctypes.create_string_buffer(len(expected))
+        self.assertEqual(lib.GetPageRecord(PAGE_RECORD_MSGPACK, PAGE_RECORD_ROWS, buf, len(expected)), len(expected))
+        self.assertEqual(buf.raw, expected)
+
+
+if __name__ == '__main__':
+    unittest.main()
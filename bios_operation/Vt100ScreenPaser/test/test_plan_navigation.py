@@ -0,0 +1,183 @@
+"""
+File Name : test_plan_navigation.py
+Description : PlanNavigation() on built pages and on the pages of a replayed capture
+"""
+
+import ctypes
+import random
+import unittest
+
+import capture
+import vt100_lib
+from vt100_lib import EntryQuery, NavQuery
+
+lib = vt100_lib.load()
+
+NAV_STEP_INTS = 2
+NAV_KEY_UP = 0
+NAV_KEY_DOWN = 1
+NAV_KEY_PAGE_UP = 2
+NAV_KEY_PAGE_DOWN = 3
+NAV_KEY_ENTER = 4
+TEXT_MATCH_ANY = 0
+TEXT_MATCH_EQUAL = 1
+TEXT_MATCH_PREFIX = 2
+TEXT_MATCH_CONTAINS = 3
+TEXT_MATCH_REGEX = 4
+ENTRY_POS_HIGHLIGHT = 2
+EntryType_DISABLE_TXT = 7
+EntryType_SUBTITLE = 8
+
+# the entries 1 and 3 are skipped by the arrows
+ENTRIES = [('drop', 'Boot Mode', b'<UEFI>'), ('sub', 'Processor', b''), ('check', 'Turbo Boost', b'[X]'),
+           ('dis', 'Locked Item', b'Disabled'), ('input', 'Ratio Limit', b'[40]'), ('menu', 'Advanced', b''),
+           ('txt', 'Build Date', b'')]
+
+
+def plan(handle, query, size=200):
+    steps = (ctypes.c_int * (size * NAV_STEP_INTS))()
+    count = lib.Vt100PlanNavigation(handle, ctypes.byref(query), steps, size * NAV_STEP_INTS)
+    return count, [tuple(steps[i * NAV_STEP_INTS:(i + 1) * NAV_STEP_INTS]) for i in range(max(0, min(count, size)))]
+
+
+def target(index, wrap=0, page_jump=0, enter=0):
+    return NavQuery(TEXT_MATCH_ANY, None, 0, index, wrap, page_jump, enter)
+
+
+def highlight(handle):
+    # the highlight entry in the indexes of GetPageEntry() with selectable_only 0
+    entries = (ctypes.c_int * 1)()
+    query = EntryQuery(0, 0, TEXT_MATCH_ANY, None, TEXT_MATCH_ANY, None, 0, ENTRY_POS_HIGHLIGHT, 0, 0)
+    return entries[0] if lib.Vt100QueryEntries(handle, ctypes.byref(query), entries, 1) == 1 else -1
+
+
+class PlanNavigationTest(unittest.TestCase):
+    def setUp(self):
+        self.handle = lib.Vt100Create(b'client')
+
+    def tearDown(self):
+        lib.Vt100Destroy(self.handle)
+
+    def feed_page(self, highlight_idx, scroll_up=False, scroll_down=False):
+        lib.Vt100Feed(self.handle, capture.page('client', ENTRIES, highlight_idx, scroll_up, scroll_down))
+        self.assertEqual(highlight(self.handle), highlight_idx)
+
+    def test_arrows_skip_subtitles_and_disabled(self):
+        self.feed_page(2)
+        self.assertEqual(plan(self.handle, target(6)), (3, [(NAV_KEY_DOWN, 4), (NAV_KEY_DOWN, 5), (NAV_KEY_DOWN, 6)]))
+        self.assertEqual(plan(self.handle, target(0, enter=1)), (2, [(NAV_KEY_UP, 0), (NAV_KEY_ENTER, -1)]))
+        self.assertEqual(plan(self.handle, target(2)), (0, []))
+
+    def test_wrap_only_if_page_cannot_scroll(self):
+        self.feed_page(0)
+        self.assertEqual(plan(self.handle, target(6, wrap=1)), (1, [(NAV_KEY_UP, 6)]))
+        self.assertEqual(plan(self.handle, target(6))[0], 4)
+        self.feed_page(0, scroll_down=True)
+        self.assertEqual(plan(self.handle, target(6, wrap=1))[0], 4)
+
+    def test_page_jump_only_if_page_cannot_scroll(self):
+        self.feed_page(0)
+        self.assertEqual(plan(self.handle, target(5, page_jump=1)), (2, [(NAV_KEY_PAGE_DOWN, 6), (NAV_KEY_UP, 5)]))
+        self.feed_page(6, scroll_down=True)
+        self.assertEqual(plan(self.handle, target(0, page_jump=1)), (1, [(NAV_KEY_PAGE_UP, 0)]))
+        self.feed_page(0, scroll_down=True)
+        self.assertEqual(plan(self.handle, target(5, page_jump=1))[0], 3)
+
+    def test_target_by_key(self):
+        self.feed_page(0)
+        query = NavQuery(TEXT_MATCH_CONTAINS, b'ratio', 1, 0, 0, 0, 1)
+        self.assertEqual(plan(self.handle, query), (3, [(NAV_KEY_DOWN, 2), (NAV_KEY_DOWN, 4), (NAV_KEY_ENTER, -1)]))
+        query = NavQuery(TEXT_MATCH_EQUAL, b'ratio', 0, 0, 0, 0, 0)
+        self.assertEqual(plan(self.handle, query)[0], -2)
+
+    def test_target_not_on_page(self):
+        self.feed_page(0)
+        for index in (1, 3, 7, -1):
+            self.assertEqual(plan(self.handle, target(index))[0], -2, index)
+        query = NavQuery(TEXT_MATCH_REGEX, b'([', 0, 0, 0, 0, 0)
+        self.assertEqual(vt100_lib.c_stdout(lambda: plan(self.handle, query)[0]), (-1, b''))
+
+    def test_steps_beyond_size_are_counted(self):
+        self.feed_page(2)
+        buf = (ctypes.c_int * (NAV_STEP_INTS + 1))(-7, -7, -7)
+        self.assertEqual(lib.Vt100PlanNavigation(self.handle, ctypes.byref(target(6)), buf, NAV_STEP_INTS + 1), 3)
+        self.assertEqual(list(buf), [NAV_KEY_DOWN, 4, -7])
+
+    def test_plans_are_shortest(self):
+        # a breadth first search over the focusable entries, then the plan is replayed
+        rng = random.Random(20)
+        planned = 0
+        for frame in capture.frames(20, 'client', 30):
+            lib.Vt100Feed(self.handle, frame)
+            entries = vt100_lib.page_entries(lib, self.handle, 0)
+            page = lib.Vt100GetSelectPage(self.handle).contents
+            scroll_up = page.is_scrollable_up
+            scroll_down = page.is_scrollable_down
+            current = highlight(self.handle)
+            focus = [i for i, entry in enumerate(entries) if entry[2] not in (EntryType_DISABLE_TXT, EntryType_SUBTITLE)]
+            for _ in range(6):
+                wrap = rng.randint(0, 1)
+                page_jump = rng.randint(0, 1)
+                enter = rng.randint(0, 1)
+                if rng.random() < 0.5 or not entries:
+                    index = rng.randrange(-1, len(entries) + 1)
+                    query = target(index, wrap, page_jump, enter)
+                    candidates = [index] if index in focus else []
+                else:
+                    key = rng.choice(entries)[0]
+                    key = key[:rng.randint(1, max(1, len(key)))]
+                    key_match = rng.choice([TEXT_MATCH_EQUAL, TEXT_MATCH_PREFIX, TEXT_MATCH_CONTAINS])
+                    query = NavQuery(key_match, key, 0, 0, wrap, page_jump, enter)
+                    candidates = [i for i in focus if
+                                  (entries[i][0] == key if key_match == TEXT_MATCH_EQUAL else
+                                   entries[i][0].startswith(key) if key_match == TEXT_MATCH_PREFIX else key in entries[i][0])]
+                count, steps = plan(self.handle, query)
+
+                can_wrap = wrap and not scroll_up and not scroll_down
+                if current not in focus or not candidates:
+                    self.assertEqual(count, -2)
+                    continue
+                last = len(focus) - 1
+                distance = {focus.index(current): 0}
+                queue = [focus.index(current)]
+                for pos in queue:
+                    moves = []
+                    if pos > 0 or can_wrap:
+                        moves.append(pos - 1 if pos > 0 else last)
+                    if pos < last or can_wrap:
+                        moves.append(pos + 1 if pos < last else 0)
+                    if page_jump and not scroll_up:
+                        moves.append(0)
+                    if page_jump and not scroll_down:
+                        moves.append(last)
+                    for move in moves:
+                        if move not in distance:
+                            distance[move] = distance[pos] + 1
+                            queue.append(move)
+                self.assertEqual(count, min(distance[focus.index(i)] for i in candidates) + enter)
+
+                pos = focus.index(current)
+                for key, expected in steps[:len(steps) - enter]:
+                    if key == NAV_KEY_UP:
+                        self.assertTrue(pos > 0 or can_wrap)
+                        pos = pos - 1 if pos > 0 else last
+                    elif key == NAV_KEY_DOWN:
+                        self.assertTrue(pos < last or can_wrap)
+                        pos = pos + 1 if pos < last else 0
+                    elif key == NAV_KEY_PAGE_UP:
+                        self.assertTrue(page_jump and not scroll_up)
+                        pos = 0
+                    else:
+                        self.assertEqual(key, NAV_KEY_PAGE_DOWN)
+                        self.assertTrue(page_jump and not scroll_down)
+                        pos = last
+                    self.assertEqual(focus[pos], expected)
+                self.assertIn(focus[pos], candidates)
+                if enter:
+                    self.assertEqual(steps[-1], (NAV_KEY_ENTER, -1))
+                planned += 1
+        self.assertGreater(planned, 30)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,78 @@
+"""
+File Name : test_popups.py
+Description : GetPopups() on pages with the boxes drawn at known places
+"""
+
+import ctypes
+import unittest
+
+import capture
+import vt100_lib
+
+lib = vt100_lib.load()
+
+SCREEN_BOX_INTS = 7
+ENTRIES = [('drop', 'Boot Mode', b'<UEFI>'), ('check', 'Turbo Boost', b'[X]'), ('input', 'Ratio Limit', b'[40]')]
+
+
+def popups(handle, size=10):
+    boxes = (ctypes.c_int * (size * SCREEN_BOX_INTS))()
+    count = lib.Vt100GetPopups(handle, boxes, size * SCREEN_BOX_INTS)
+    return [tuple(boxes[i * SCREEN_BOX_INTS:(i + 1) * SCREEN_BOX_INTS]) for i in range(min(count, size))]
+
+
+class PopupsTest(unittest.TestCase):
+    def setUp(self):
+        self.handle = lib.Vt100Create(b'client')
+
+    def tearDown(self):
+        lib.Vt100Destroy(self.handle)
+
+    def feed(self, boxes):
+        lib.Vt100CleanScreenData(self.handle)
+        lib.Vt100Feed(self.handle, capture.page('client', ENTRIES, 0, popups=boxes))
+
+    def test_no_box(self):
+        self.feed([])
+        self.assertEqual(popups(self.handle), [])
+
+    def test_box_and_scroll_marks(self):
+        # top row, bottom row, left column, right column + 1, depth, scroll up, scroll down
+        self.feed([(8, 14, 30, 60, False, True)])
+        self.assertEqual(popups(self.handle), [(8, 13, 30, 60, 0, 0, 1)])
+        self.feed([(8, 14, 30, 60, True, False)])
+        self.assertEqual(popups(self.handle), [(8, 13, 30, 60, 0, 1, 0)])
+
+    def test_boxes_side_by_side(self):
+        self.feed([(8, 14, 5, 30, False, False), (9, 12, 50, 80, True, False)])
+        self.assertEqual(popups(self.handle), [(8, 13, 5, 30, 0, 0, 0), (9, 11, 50, 80, 0, 1, 0)])
+
+    def test_nested_boxes(self):
+        self.feed([(7, 20, 20, 80, False, False), (10, 15, 30, 60, True, True)])
+        self.assertEqual(popups(self.handle), [(7, 19, 20, 80, 0, 0, 0), (10, 14, 30, 60, 1, 1, 1)])
+
+    def test_boxes_beyond_size_are_counted(self):
+        self.feed([(8, 14, 5, 30, False, False), (9, 12, 50, 80, True, False)])
+        buf = (ctypes.c_int * (SCREEN_BOX_INTS + 1))(*([-7] * (SCREEN_BOX_INTS + 1)))
+        self.assertEqual(lib.Vt100GetPopups(self.handle, buf, SCREEN_BOX_INTS + 1), 2)
+        self.assertEqual(list(buf), [8, 13, 5, 30, 0, 0, 0, -7])
+
+    def test_popup_pages_of_capture(self):
+        # the popups of capture.screen() are 30 columns wide in the middle of the screen
+        found = 0
+        for frame in capture.frames(13, 'client', 30):
+            if b'\x1b[2J' not in frame:
+                continue
+            lib.Vt100Feed(self.handle, frame)
+            boxes = [box for box in popups(self.handle) if box[2:4] == (35, 65)]
+            self.assertLessEqual(len(boxes), 1)
+            if boxes:
+                top, bottom, beg, end, depth, up, down = boxes[0]
+                self.assertEqual((top, depth, up, down), (8, 0, 0, 0))
+                self.assertIn(bottom - top - 1, range(2, 6))
+                found += 1
+        self.assertGreater(found, 0)
+
+
+if __name__ == '__main__':
+    unittest.main()
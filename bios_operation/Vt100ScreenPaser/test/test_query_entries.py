@@ -0,0 +1,128 @@
+"""
+File Name : test_query_entries.py
+Description : QueryEntries() and GetPageEntry() on the pages of a replayed capture
+"""
+
+import ctypes
+import random
+import re
+import unittest
+
+import capture
+import vt100_lib
+from vt100_lib import EntryQuery
+
+lib = vt100_lib.load()
+
+TEXT_MATCH_ANY = 0
+TEXT_MATCH_EQUAL = 1
+TEXT_MATCH_PREFIX = 2
+TEXT_MATCH_CONTAINS = 3
+TEXT_MATCH_REGEX = 4
+ENTRY_POS_ANY = 0
+ENTRY_POS_INDEX = 1
+ENTRY_POS_HIGHLIGHT = 2
+
+
+def text_matched(text, match, pattern, ignore_case):
+    if match == TEXT_MATCH_ANY:
+        return True
+    if match == TEXT_MATCH_REGEX:
+        return re.search(pattern.decode('latin-1'), text.decode('latin-1'), re.I if ignore_case else 0) is not None
+    if ignore_case:
+        text = text.upper()
+        pattern = pattern.upper()
+    if match == TEXT_MATCH_EQUAL:
+        return text == pattern
+    if match == TEXT_MATCH_PREFIX:
+        return text.startswith(pattern)
+    return pattern in text
+
+
+def query_entries(handle, query, size=64):
+    entries = (ctypes.c_int * size)()
+    count = lib.Vt100QueryEntries(handle, ctypes.byref(query), entries, size)
+    return count, list(entries[:max(0, min(count, size))])
+
+
+class QueryEntriesTest(unittest.TestCase):
+    def setUp(self):
+        self.handle = lib.Vt100Create(b'client')
+
+    def tearDown(self):
+        lib.Vt100Destroy(self.handle)
+
+    def test_query_is_every_filter(self):
+        rng = random.Random(17)
+        queries = 0
+        matched = 0
+        for frame in capture.frames(17, 'client', 40):
+            lib.Vt100Feed(self.handle, frame)
+            page = lib.Vt100GetSelectPage(self.handle).contents
+            for selectable_only in (0, 1):
+                entries = vt100_lib.page_entries(lib, self.handle, selectable_only)
+                words = [key[:rng.randint(0, 6)] for key, value, entry_type in entries] + \
+                        [value[:3] for key, value, entry_type in entries] + [b'boot', b'[', b'e']
+                for _ in range(6):
+                    key_match = rng.randint(TEXT_MATCH_ANY, TEXT_MATCH_REGEX)
+                    value_match = rng.choice([TEXT_MATCH_ANY, TEXT_MATCH_ANY, TEXT_MATCH_EQUAL, TEXT_MATCH_PREFIX,
+                                              TEXT_MATCH_CONTAINS, TEXT_MATCH_REGEX])
+                    key = rng.choice(words)
+                    value = rng.choice(words)
+                    if key_match == TEXT_MATCH_REGEX:
+                        key = re.escape(key.decode('latin-1')).encode('latin-1') + rng.choice([b'', b'.*', b'\\s'])
+                    if value_match == TEXT_MATCH_REGEX:
+                        value = b'^' + re.escape(value.decode('latin-1')).encode('latin-1')
+                    types = rng.choice([0, 0, 1 << 2, (1 << 7) | (1 << 8), (1 << 1) | (1 << 6), (1 << 3) | (1 << 4) | (1 << 5)])
+                    pos_match = rng.choice([ENTRY_POS_ANY, ENTRY_POS_INDEX] + ([ENTRY_POS_HIGHLIGHT] if selectable_only else []))
+                    pos_beg = rng.randint(-3, 3)
+                    pos_end = pos_beg + rng.randint(0, 4)
+                    ignore_case = rng.randint(0, 1)
+                    query = EntryQuery(selectable_only, types, key_match, key, value_match, value, ignore_case,
+                                       pos_match, pos_beg, pos_end)
+                    expected = []
+                    for i, (entry_key, entry_value, entry_type) in enumerate(entries):
+                        if pos_match == ENTRY_POS_INDEX and not pos_beg <= i <= pos_end:
+                            continue
+                        if pos_match == ENTRY_POS_HIGHLIGHT and (page.highlight_idx == -1 or
+                                                                 not page.highlight_idx + pos_beg <= i <= page.highlight_idx + pos_end):
+                            continue
+                        if types and not types & (1 << entry_type):
+                            continue
+                        if text_matched(entry_key, key_match, key, ignore_case) and \
+                                text_matched(entry_value, value_match, value, ignore_case):
+                            expected.append(i)
+                    count, got = query_entries(self.handle, query)
+                    self.assertEqual((count, got), (len(expected), expected), (key_match, key, value_match, value))
+                    queries += 1
+                    matched += len(expected) > 0
+        # the queries are not all empty
+        self.assertGreater(matched, queries // 10)
+
+    def test_page_entries_are_select_page(self):
+        for frame in capture.frames(18, 'client', 10) + capture.frames(19, 'server', 10):
+            lib.Vt100Feed(self.handle, frame)
+            page = lib.Vt100GetSelectPage(self.handle).contents.values()
+            entries = vt100_lib.page_entries(lib, self.handle, 1)
+            self.assertEqual([(key, value, b'%d' % entry_type) for key, value, entry_type in entries], page[7])
+
+    def test_entries_beyond_size_are_counted(self):
+        lib.Vt100Feed(self.handle, capture.frames(20, 'client', 1)[0])
+        query = EntryQuery(0, 0, TEXT_MATCH_ANY, None, TEXT_MATCH_ANY, None, 0, ENTRY_POS_ANY, 0, 0)
+        count, entries = query_entries(self.handle, query)
+        self.assertGreater(count, 2)
+        buf = (ctypes.c_int * 3)(-7, -7, -7)
+        self.assertEqual(lib.Vt100QueryEntries(self.handle, ctypes.byref(query), buf, 2), count)
+        self.assertEqual(list(buf), entries[:2] + [-7])
+
+    def test_invalid_query(self):
+        lib.Vt100Feed(self.handle, capture.frames(20, 'client', 1)[0])
+        query = EntryQuery(1, 0, TEXT_MATCH_REGEX, b'([', TEXT_MATCH_ANY, None, 0, ENTRY_POS_ANY, 0, 0)
+        # nothing is printed, the caller gets -1
+        self.assertEqual(vt100_lib.c_stdout(lambda: query_entries(self.handle, query)[0]), (-1, b''))
+        query = EntryQuery(1, 0, 9, b'Boot', TEXT_MATCH_ANY, None, 0, ENTRY_POS_ANY, 0, 0)
+        self.assertEqual(query_entries(self.handle, query)[0], -1)
+
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,89 @@
+"""
+File Name : test_screen_packed.py
+Description : GetScreenPacked() and GetScreenRowsPacked() against GetScreenColored() on a replayed capture
+"""
+
+import ctypes
+import random
+import unittest
+
+import capture
+import vt100_lib
+
+lib = vt100_lib.load()
+
+SCREEN_CELL_BYTES = 4
+
+
+def packed_cells(rows, attrs, row_beg, row_end):
+    # the bytes GetScreenPacked() writes for the rows [row_beg, row_end) of screen_cells()
+    out = bytearray()
+    for row in range(row_beg, row_end):
+        for col, (fg, bg, text) in enumerate(attrs[row]):
+            out += bytes((rows[row][col], fg, bg, text))
+    return bytes(out)
+
+
+class ScreenPackedTest(unittest.TestCase):
+    def setUp(self):
+        self.handle = lib.Vt100Create(b'client')
+
+    def tearDown(self):
+        lib.Vt100Destroy(self.handle)
+
+    def test_cells_are_screen_colored(self):
+        rng = random.Random(22)
+        for frame in capture.frames(22, 'client', 12):
+            lib.Vt100Feed(self.handle, frame)
+            rows, attrs = vt100_lib.screen_cells(lib, self.handle)
+            height = len(rows)
+            size = height * len(rows[0]) * SCREEN_CELL_BYTES
+            buf = ctypes.create_string_buffer(size)
+            self.assertEqual(lib.Vt100GetScreenPacked(self.handle, buf, size), size)
+            self.assertEqual(buf.raw, packed_cells(rows, attrs, 0, height))
+
+            row_beg = rng.randrange(height)
+            row_end = rng.randrange(row_beg, height + 1)
+            expected = packed_cells(rows, attrs, row_beg, row_end)
+            buf = ctypes.create_string_buffer(size)
+            self.assertEqual(lib.Vt100GetScreenRowsPacked(self.handle, row_beg, row_end, buf, size), len(expected))
+            self.assertEqual(buf.raw[:len(expected)], expected)
+            # row_end -1 for the rows after row_beg
+            expected = packed_cells(rows, attrs, row_beg, height)
+            self.assertEqual(lib.Vt100GetScreenRowsPacked(self.handle, row_beg, -1, buf, size), len(expected))
+            self.assertEqual(buf.raw[:len(expected)], expected)
+
+    def test_cells_beyond_size_are_not_written(self):
+        lib.Vt100Feed(self.handle, capture.frames(22, 'client', 1)[0])
+        rows, attrs = vt100_lib.screen_cells(lib, self.handle)
+        expected = packed_cells(rows, attrs, 0, len(rows))
+        # a part of a cell is not written
+        size = 10 * SCREEN_CELL_BYTES + 3
+        buf = ctypes.create_string_buffer(b'\xf9' * (size + 8), size + 8)
+        self.assertEqual(lib.Vt100GetScreenPacked(self.handle, buf, size), len(expected))
+        self.assertEqual(buf.raw[:10 * SCREEN_CELL_BYTES], expected[:10 * SCREEN_CELL_BYTES])
+        self.assertEqual(buf.raw[10 * SCREEN_CELL_BYTES:], b'\xf9' * 11)
+        self.assertEqual(lib.Vt100GetScreenPacked(self.handle, None, 0), len(expected))
+
+    def test_empty_rows(self):
+        lib.Vt100Feed(self.handle, capture.frames(22, 'client', 1)[0])
+        buf = ctypes.create_string_buffer(64)
+        self.assertEqual(lib.Vt100GetScreenRowsPacked(self.handle, 5, 5, buf, 64), 0)
+        self.assertEqual(lib.Vt100GetScreenRowsPacked(self.handle, 7, 3, buf, 64), 0)
+        self.assertEqual(lib.Vt100GetScreenRowsPacked(self.handle, 1000, -1, buf, 64), 0)
+
+    def test_without_handle(self):
+        lib.Init(b'client')
+        frame = capture.frames(22, 'client', 1)[0]
+        lib.Feed(frame)
+        lib.Vt100Feed(self.handle, frame)
+        size = lib.Vt100GetScreenPacked(self.handle, None, 0)
+        expected = ctypes.create_string_buffer(size)
+        lib.Vt100GetScreenPacked(self.handle, expected, size)
+        buf = ctypes.create_string_buffer(size)
+        self.assertEqual(lib.GetScreenPacked(buf, size), size)
+        self.assertEqual(buf.raw, expected.raw)
+
+
+if __name__ == '__main__':
+    unittest.main()
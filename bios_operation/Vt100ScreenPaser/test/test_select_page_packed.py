@@ -0,0 +1,106 @@
+"""
+File Name : test_select_page_packed.py
+Description : GetSelectPagePacked() against GetSelectPage() on a replayed capture
+"""
+
+import ctypes
+import struct
+import unittest
+
+import capture
+import vt100_lib
+
+lib = vt100_lib.load()
+
+PACKED_PAGE = struct.Struct('=4i2i2i')
+PACKED_ENTRY = struct.Struct('=2i2i1i')
+PACKED_PAGE_SCROLLABLE_UP = 0x01
+PACKED_PAGE_SCROLLABLE_DOWN = 0x02
+PACKED_PAGE_DIALOG_BOX = 0x04
+PACKED_PAGE_POPUP = 0x08
+
+
+def text(buf, offset, length):
+    # a text is followed by a '\0'
+    assert buf[offset + length] == 0
+    return buf[offset:offset + length]
+
+
+def unpack(buf):
+    # the size, the page as SelectPage.values() but the entries, and the (key, value, type) of the entries
+    size, count, highlight_idx, flags, titles_off, titles_len, desc_off, desc_len = PACKED_PAGE.unpack_from(buf)
+    entries = []
+    for i in range(count):
+        key_off, key_len, value_off, value_len, entry_type = \
+            PACKED_ENTRY.unpack_from(buf, PACKED_PAGE.size + i * PACKED_ENTRY.size)
+        entries.append((text(buf, key_off, key_len), text(buf, value_off, value_len), entry_type))
+    page = (text(buf, titles_off, titles_len), text(buf, desc_off, desc_len), highlight_idx,
+            bool(flags & PACKED_PAGE_SCROLLABLE_UP), bool(flags & PACKED_PAGE_SCROLLABLE_DOWN),
+            bool(flags & PACKED_PAGE_DIALOG_BOX), bool(flags & PACKED_PAGE_POPUP))
+    return size, page, entries
+
+
+def packed_page(handle):
+    size = lib.Vt100GetSelectPagePacked(handle, None, 0)
+    buf = ctypes.create_string_buffer(size)
+    assert lib.Vt100GetSelectPagePacked(handle, buf, size) == size
+    return buf.raw
+
+
+class SelectPagePackedTest(unittest.TestCase):
+    def setUp(self):
+        self.handle = lib.Vt100Create(b'client')
+
+    def tearDown(self):
+        lib.Vt100Destroy(self.handle)
+
+    def test_page_is_select_page(self):
+        pages = 0
+        for frame in capture.frames(23, 'client', 30):
+            lib.Vt100Feed(self.handle, frame)
+            buf = packed_page(self.handle)
+            size, page, entries = unpack(buf)
+            self.assertEqual(size, len(buf))
+            # the header, the entries, and each text with its '\0'
+            texts = [page[0], page[1]] + [entry[i] for entry in entries for i in range(2)]
+            self.assertEqual(size, PACKED_PAGE.size + len(entries) * PACKED_ENTRY.size + sum(len(t) + 1 for t in texts))
+            expected = lib.Vt100GetSelectPage(self.handle).contents.values()
+            self.assertEqual(page, expected[:7])
+            self.assertEqual([entry[:2] for entry in entries], [entry[:2] for entry in expected[7]])
+            self.assertEqual(entries, vt100_lib.page_entries(lib, self.handle, 1))
+            pages += len(entries) > 0
+        self.assertGreater(pages, 10)
+
+    def test_short_buffer_is_not_written(self):
+        lib.Vt100Feed(self.handle, capture.frames(23, 'client', 1)[0])
+        size = lib.Vt100GetSelectPagePacked(self.handle, None, 0)
+        self.assertGreater(size, PACKED_PAGE.size)
+        for short in (0, 1, PACKED_PAGE.size, size - 1):
+            buf = ctypes.create_string_buffer(b'\xf9' * size, size)
+            self.assertEqual(lib.Vt100GetSelectPagePacked(self.handle, buf, short), size)
+            self.assertEqual(buf.raw, b'\xf9' * size)
+        # a longer buffer gets the same page
+        buf = ctypes.create_string_buffer(size + 16)
+        self.assertEqual(lib.Vt100GetSelectPagePacked(self.handle, buf, size + 16), size)
+        self.assertEqual(buf.raw[:size], packed_page(self.handle))
+
+    def test_buffer(self):
+        for frame in capture.frames(23, 'client', 5):
+            lib.Vt100Feed(self.handle, frame)
+            size = ctypes.c_int()
+            buf = lib.Vt100GetSelectPageBuffer(self.handle, ctypes.byref(size))
+            self.assertEqual(buf[:size.value], packed_page(self.handle))
+
+    def test_without_handle(self):
+        frame = capture.frames(23, 'client', 1)[0]
+        lib.Init(b'client')
+        lib.Feed(frame)
+        lib.Vt100Feed(self.handle, frame)
+        expected = packed_page(self.handle)
+        buf = ctypes.create_string_buffer(len(expected))
+        self.assertEqual(lib.GetSelectPagePacked(buf, len(expected)), len(expected))
+        self.assertEqual(buf.raw, expected)
+
+
+if __name__ == '__main__':
+    unittest.main()
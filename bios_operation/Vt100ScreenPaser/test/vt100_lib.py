@@ -0,0 +1,184 @@
+"""
+File Name : vt100_lib.py
+Description : load the library for the tests and declare the exports they call
+"""
+
+import ctypes
+import os
+import sys
+import tempfile
+
+LIB_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+class SelectPage(ctypes.Structure):
+    _fields_ = [('entries', ctypes.c_char * 500 * 3 * 31),
+                ('entries_count', ctypes.c_int),
+                ('titles', ctypes.c_char * 1000),
+                ('description', ctypes.c_char * 1000),
+                ('highlight_idx', ctypes.c_int),
+                ('is_scrollable_up', ctypes.c_bool),
+                ('is_scrollable_down', ctypes.c_bool),
+                ('is_dialog_box', ctypes.c_bool),
+                ('is_popup', ctypes.c_bool)]
+
+    def values(self):
+        entries = [tuple(self.entries[i][j].value for j in range(3)) for i in range(self.entries_count)]
+        return (self.titles, self.description, self.highlight_idx, self.is_scrollable_up,
+                self.is_scrollable_down, self.is_dialog_box, self.is_popup, entries)
+
+
+class WholePage(ctypes.Structure):
+    _fields_ = [('heigh', ctypes.c_int),
+                ('width', ctypes.c_int),
+                ('data', ctypes.c_char * 100 * 31)]
+
+    def rows(self):
+        return [bytes(self.data[i])[:self.width] for i in range(self.heigh)]
+
+
+class ScreenStruct(ctypes.Structure):
+    _fields_ = [('heigh', ctypes.c_int),
+                ('width', ctypes.c_int),
+                ('data', ctypes.c_char * 25 * 4 * 100 * 31)]
+
+
+class TextQuery(ctypes.Structure):
+    _fields_ = [('pattern', ctypes.c_char_p),
+                ('ignore_case', ctypes.c_int),
+                ('row_beg', ctypes.c_int),
+                ('row_end', ctypes.c_int),
+                ('col_beg', ctypes.c_int),
+                ('col_end', ctypes.c_int),
+                ('fg', ctypes.c_int),
+                ('bg', ctypes.c_int),
+                ('text', ctypes.c_int)]
+
+
+class NavQuery(ctypes.Structure):
+    _fields_ = [('key_match', ctypes.c_int),
+                ('key', ctypes.c_char_p),
+                ('ignore_case', ctypes.c_int),
+                ('target', ctypes.c_int),
+                ('wrap', ctypes.c_int),
+                ('page_jump', ctypes.c_int),
+                ('enter', ctypes.c_int)]
+
+
+class EntryQuery(ctypes.Structure):
+    _fields_ = [('selectable_only', ctypes.c_int),
+                ('types', ctypes.c_int),
+                ('key_match', ctypes.c_int),
+                ('key', ctypes.c_char_p),
+                ('value_match', ctypes.c_int),
+                ('value', ctypes.c_char_p),
+                ('ignore_case', ctypes.c_int),
+                ('pos_match', ctypes.c_int),
+                ('pos_beg', ctypes.c_int),
+                ('pos_end', ctypes.c_int)]
+
+
+# the names of GetScreenColored() by the code - 30, the code - 40 and the text attribute
+COLOR_NAMES = [b'black', b'red', b'green', b'brown', b'blue', b'magenta', b'cyan', b'white', None, b'default']
+TEXT_NAMES = [b'default', b'+bold', None, b'+italics', b'+underscore', None, None, b'+reverse', None, b'+strikethrough'] + \
+             [None] * 12 + [b'-bold', b'-italics', b'-underscore', None, None, b'-reverse', None, b'-strikethrough']
+
+
+def load():
+    # VT100_SCREEN_LIB selects the library, else the 64 bit build of "How to build?"
+    path = os.environ.get('VT100_SCREEN_LIB')
+    if path is None:
+        name = 'Vt100ScreenPaser64.dll' if sys.platform == 'win32' else 'Vt100ScreenPaser64.so'
+        path = os.path.join(LIB_DIR, name)
+    lib = ctypes.CDLL(path)
+
+    handle = ctypes.c_void_p
+    lib.Vt100Create.restype = handle
+    lib.Vt100Create.argtypes = [ctypes.c_char_p]
+    lib.Vt100Destroy.argtypes = [handle]
+    lib.Vt100Feed.argtypes = [handle, ctypes.c_char_p]
+    lib.Vt100FeedBytes.argtypes = [handle, ctypes.c_char_p, ctypes.c_size_t]
+    lib.Vt100LoadNoiseFilter.argtypes = [handle, ctypes.c_char_p]
+    lib.Vt100GetNoiseFilterHits.argtypes = [handle, ctypes.c_char_p]
+    lib.Vt100ParseEdkShell.restype = ctypes.c_char_p
+    lib.Vt100ParseEdkShell.argtypes = [handle, ctypes.c_char_p, ctypes.c_bool]
+    lib.ParseEdkShell.restype = ctypes.c_char_p
+    lib.ParseEdkShell.argtypes = [ctypes.c_char_p, ctypes.c_bool]
+    lib.LoadNoiseFilter.argtypes = [ctypes.c_char_p]
+    lib.GetNoiseFilterHits.argtypes = [ctypes.c_char_p]
+    lib.Init.argtypes = [ctypes.c_char_p]
+    lib.Feed.argtypes = [ctypes.c_char_p]
+    lib.FeedBytes.argtypes = [ctypes.c_char_p, ctypes.c_size_t]
+    lib.CheckVt100Draw.argtypes = [ctypes.c_char_p]
+    lib.CheckVt100Draw.restype = ctypes.c_bool
+    lib.GetScreenColored.restype = ScreenStruct
+    lib.GetSelectPage.restype = SelectPage
+    lib.GetWholePage.restype = WholePage
+    lib.Vt100GetSelectPage.restype = ctypes.POINTER(SelectPage)
+    lib.Vt100GetSelectPage.argtypes = [handle]
+    lib.Vt100GetWholePage.restype = ctypes.POINTER(WholePage)
+    lib.Vt100GetWholePage.argtypes = [handle]
+    lib.Vt100QueryEntries.argtypes = [handle, ctypes.POINTER(EntryQuery), ctypes.POINTER(ctypes.c_int), ctypes.c_int]
+    lib.Vt100GetPageEntry.argtypes = [handle, ctypes.c_int, ctypes.c_int, ctypes.c_char_p, ctypes.c_int,
+                                      ctypes.c_char_p, ctypes.c_int]
+    lib.Vt100GetScreenColored.restype = ctypes.POINTER(ScreenStruct)
+    lib.Vt100GetScreenColored.argtypes = [handle]
+    lib.Vt100FindText.argtypes = [handle, ctypes.POINTER(TextQuery), ctypes.POINTER(ctypes.c_int), ctypes.c_int]
+    lib.Vt100FindKeys.argtypes = [handle, ctypes.c_char_p, ctypes.c_int, ctypes.POINTER(ctypes.c_int), ctypes.c_int]
+    lib.Vt100PlanNavigation.argtypes = [handle, ctypes.POINTER(NavQuery), ctypes.POINTER(ctypes.c_int), ctypes.c_int]
+    lib.Vt100CleanScreenData.argtypes = [handle]
+    lib.Vt100GetScreenPacked.argtypes = [handle, ctypes.c_char_p, ctypes.c_int]
+    lib.Vt100GetScreenRowsPacked.argtypes = [handle, ctypes.c_int, ctypes.c_int, ctypes.c_char_p, ctypes.c_int]
+    lib.GetScreenPacked.argtypes = [ctypes.c_char_p, ctypes.c_int]
+    lib.Vt100GetSelectPagePacked.argtypes = [handle, ctypes.c_char_p, ctypes.c_int]
+    lib.Vt100GetSelectPageBuffer.restype = ctypes.POINTER(ctypes.c_char)
+    lib.Vt100GetSelectPageBuffer.argtypes = [handle, ctypes.POINTER(ctypes.c_int)]
+    lib.GetSelectPagePacked.argtypes = [ctypes.c_char_p, ctypes.c_int]
+    lib.Vt100GetPageRecord.argtypes = [handle, ctypes.c_int, ctypes.c_int, ctypes.c_char_p, ctypes.c_int]
+    lib.Vt100GetPageRecordBuffer.restype = ctypes.POINTER(ctypes.c_char)
+    lib.Vt100GetPageRecordBuffer.argtypes = [handle, ctypes.c_int, ctypes.c_int, ctypes.POINTER(ctypes.c_int)]
+    lib.GetPageRecord.argtypes = [ctypes.c_int, ctypes.c_int, ctypes.c_char_p, ctypes.c_int]
+    lib.Vt100GetPopups.argtypes = [handle, ctypes.POINTER(ctypes.c_int), ctypes.c_int]
+    return lib
+
+
+def screen_cells(lib, handle):
+    # the chars of each row and the (fg, bg, text) of each cell of GetScreenColored()
+    screen = lib.Vt100GetScreenColored(handle).contents
+    rows = []
+    attrs = []
+    for row in range(screen.heigh):
+        cells = screen.data[row]
+        rows.append(b''.join(cells[col][0].raw[:1] for col in range(screen.width)))
+        attrs.append([(30 + COLOR_NAMES.index(cells[col][1].value), 40 + COLOR_NAMES.index(cells[col][2].value),
+                       TEXT_NAMES.index(cells[col][3].value)) for col in range(screen.width)])
+    return rows, attrs
+
+
+def page_entries(lib, handle, selectable_only):
+    # the (key, value, type) of the entries of GetPageEntry()
+    key = ctypes.create_string_buffer(1024)
+    value = ctypes.create_string_buffer(1024)
+    entries = []
+    while True:
+        entry_type = lib.Vt100GetPageEntry(handle, selectable_only, len(entries), key, len(key), value, len(value))
+        if entry_type < 0:
+            return entries
+        entries.append((key.value, value.value, entry_type))
+
+
+def c_stdout(call):
+    # the result of call() and what the library printed to the stdout meanwhile
+    sys.stdout.flush()
+    libc = ctypes.CDLL(None)
+    with tempfile.TemporaryFile() as out:
+        saved = os.dup(1)
+        os.dup2(out.fileno(), 1)
+        try:
+            result = call()
+            libc.fflush(None)
+        finally:
+            os.dup2(saved, 1)
+            os.close(saved)
+        out.seek(0)
+        return result, out.read()
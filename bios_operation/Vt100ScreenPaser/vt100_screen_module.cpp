@@ -0,0 +1,379 @@
+/*
+File Name : vt100_screen_module.cpp
+Description : The python module vt100_screen, it wraps Vt100ScreenParser as a
+              python object without ctypes.
+*/
+
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+#include <pythread.h>
+
+#include <cstring>
+#include <vector>
+
+#include "vt100_screen_parse.h"
+
+using namespace std;
+
+// a Vt100ScreenParser, the calls are serialised by the lock as feed() runs
+// without the GIL
+struct ParserObject
+{
+    PyObject_HEAD
+    Vt100ScreenParser *parser;
+    PyThread_type_lock lock;
+    vector<char> *select_page; // packed
+};
+
+// the chars or the attributes of the cells of a parser, exported to memoryview
+struct PlaneObject
+{
+    PyObject_HEAD
+    ParserObject *owner;
+    bool attrs;
+    Py_ssize_t shape[2];
+    Py_ssize_t strides[2];
+};
+
+// made from the specs by PyInit_vt100_screen()
+static PyTypeObject *ParserType = NULL;
+static PyTypeObject *PlaneType = NULL;
+
+static void LockParser(ParserObject *self)
+{
+    // wait for feed() without the GIL
+    if (!PyThread_acquire_lock(self->lock, NOWAIT_LOCK))
+    {
+        Py_BEGIN_ALLOW_THREADS
+        PyThread_acquire_lock(self->lock, WAIT_LOCK);
+        Py_END_ALLOW_THREADS
+    }
+}
+
+static void UnlockParser(ParserObject *self)
+{
+    PyThread_release_lock(self->lock);
+}
+
+static int ParserInit(ParserObject *self, PyObject *args, PyObject *kwds)
+{
+    static const char *kwlist[] = {"platform", NULL};
+    const char *platform = "client";
+    if (!PyArg_ParseTupleAndKeywords(args, kwds, "|s", (char **)kwlist, &platform))
+        return -1;
+    if (self->parser != NULL)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "the parser is initialized");
+        return -1;
+    }
+    self->lock = PyThread_allocate_lock();
+    if (self->lock == NULL)
+    {
+        PyErr_NoMemory();
+        return -1;
+    }
+    self->parser = new Vt100ScreenParser(platform);
+    self->select_page = new vector<char>();
+    return 0;
+}
+
+static void ParserDealloc(ParserObject *self)
+{
+    delete self->parser;
+    delete self->select_page;
+    if (self->lock != NULL)
+        PyThread_free_lock(self->lock);
+    // an object of a heap type holds a reference to its type
+    PyTypeObject *type = Py_TYPE(self);
+    type->tp_free((PyObject *)self);
+    Py_DECREF(type);
+}
+
+static bool CheckParser(ParserObject *self)
+{
+    if (self->parser == NULL)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Error: Need init");
+        return false;
+    }
+    return true;
+}
+
+static PyObject *ParserFeed(ParserObject *self, PyObject *args)
+{
+    // feed(data): parse the serial data, a bytes-like object
+    Py_buffer data;
+    if (!CheckParser(self) || !PyArg_ParseTuple(args, "y*", &data))
+        return NULL;
+    Py_BEGIN_ALLOW_THREADS
+    PyThread_acquire_lock(self->lock, WAIT_LOCK);
+    self->parser->FeedBytes((const uint8_t *)data.buf, data.len);
+    PyThread_release_lock(self->lock);
+    Py_END_ALLOW_THREADS
+    PyBuffer_Release(&data);
+    Py_RETURN_NONE;
+}
+
+static PyObject *ParserCleanScreenData(ParserObject *self, PyObject *)
+{
+    if (!CheckParser(self))
+        return NULL;
+    LockParser(self);
+    self->parser->CleanScreenData();
+    UnlockParser(self);
+    Py_RETURN_NONE;
+}
+
+static PyObject *ParserSize(ParserObject *self, PyObject *)
+{
+    // size(): (height, width) of the screen
+    if (!CheckParser(self))
+        return NULL;
+    return Py_BuildValue("(ii)", self->parser->GetHeight(), self->parser->GetWidth());
+}
+
+static PyObject *ParserPlane(ParserObject *self, bool attrs)
+{
+    // a memoryview of the cells, it is changed by feed() in place
+    if (!CheckParser(self))
+        return NULL;
+    PlaneObject *plane = PyObject_New(PlaneObject, PlaneType);
+    if (plane == NULL)
+        return NULL;
+    Py_INCREF(self);
+    plane->owner = self;
+    plane->attrs = attrs;
+    plane->shape[0] = self->parser->GetHeight();
+    plane->shape[1] = self->parser->GetWidth();
+    plane->strides[1] = attrs ? sizeof(CellAttr) : sizeof(char);
+    plane->strides[0] = plane->strides[1] * plane->shape[1];
+    PyObject *view = PyMemoryView_FromObject((PyObject *)plane);
+    Py_DECREF(plane);
+    return view;
+}
+
+static PyObject *ParserChars(ParserObject *self, PyObject *)
+{
+    // chars(): memoryview of the chars of the cells, format 'B', shape (height, width)
+    return ParserPlane(self, false);
+}
+
+static PyObject *ParserAttrs(ParserObject *self, PyObject *)
+{
+    // attrs(): memoryview of the display attributes of the cells, format 'H',
+    // shape (height, width): fg - 30 in bits 0-3, bg - 40 in bits 4-7, text from bit 8
+    return ParserPlane(self, true);
+}
+
+static PyObject *PackedTextBytes(const char *page, const PackedText &text)
+{
+    return PyBytes_FromStringAndSize(page + text.offset, text.len);
+}
+
+static PyObject *ParserSelectPage(ParserObject *self, PyObject *)
+{
+    /*
+        select_page(): the page of GetSelectPage() without its limits,
+        (titles, description, highlight_idx, is_scrollable_up,
+        is_scrollable_down, is_dialog_box, is_popup, entries), an entry is
+        (key, value, type)
+    */
+    if (!CheckParser(self))
+        return NULL;
+    // the packed page is read under the lock, it is kept in the object
+    LockParser(self);
+    vector<char> &buf = *self->select_page;
+    buf.resize(self->parser->GetSelectPagePacked(NULL, 0));
+    self->parser->GetSelectPagePacked(&buf[0], buf.size());
+
+    const char *page = &buf[0];
+    PackedPage header;
+    memcpy(&header, page, sizeof(header));
+    PyObject *entries = PyList_New(header.entries_count);
+    for (int i = 0; entries != NULL && i < header.entries_count; i++)
+    {
+        PackedEntry entry;
+        memcpy(&entry, page + sizeof(PackedPage) + i * sizeof(PackedEntry), sizeof(entry));
+        PyObject *item = Py_BuildValue("(NNi)", PackedTextBytes(page, entry.key), PackedTextBytes(page, entry.value), entry.type);
+        if (item == NULL)
+            Py_CLEAR(entries);
+        else
+            PyList_SET_ITEM(entries, i, item);
+    }
+    PyObject *result = NULL;
+    if (entries != NULL)
+        result = Py_BuildValue("(NNiOOOON)", PackedTextBytes(page, header.titles), PackedTextBytes(page, header.description),
+                               header.highlight_idx,
+                               (header.flags & PACKED_PAGE_SCROLLABLE_UP) ? Py_True : Py_False,
+                               (header.flags & PACKED_PAGE_SCROLLABLE_DOWN) ? Py_True : Py_False,
+                               (header.flags & PACKED_PAGE_DIALOG_BOX) ? Py_True : Py_False,
+                               (header.flags & PACKED_PAGE_POPUP) ? Py_True : Py_False, entries);
+    UnlockParser(self);
+    return result;
+}
+
+static PyObject *ParserEntries(ParserObject *self, PyObject *args)
+{
+    // entries(selectable_only=0): the (key, value, type) of the entries, as GetPageEntry()
+    int selectable_only = 0;
+    if (!CheckParser(self) || !PyArg_ParseTuple(args, "|i", &selectable_only))
+        return NULL;
+    PyObject *entries = PyList_New(0);
+    if (entries == NULL)
+        return NULL;
+    LockParser(self);
+    TextView key;
+    TextView value;
+    int type;
+    for (int i = 0; (type = self->parser->GetPageEntry(selectable_only != 0, i, &key, &value)) != -1; i++)
+    {
+        PyObject *item = Py_BuildValue("(y#y#i)", key.data_, (Py_ssize_t)key.len_, value.data_, (Py_ssize_t)value.len_, type);
+        if (item == NULL || PyList_Append(entries, item) < 0)
+        {
+            Py_XDECREF(item);
+            Py_DECREF(entries);
+            entries = NULL;
+            break;
+        }
+        Py_DECREF(item);
+    }
+    UnlockParser(self);
+    return entries;
+}
+
+static PyObject *ParserGetValueByKey(ParserObject *self, PyObject *args)
+{
+    // get_value_by_key(key): the values of the entries whose key contains the key, joined by ';'
+    Py_buffer key;
+    if (!CheckParser(self) || !PyArg_ParseTuple(args, "s*", &key))
+        return NULL;
+    LockParser(self);
+    PyObject *values = PyBytes_FromString(self->parser->GetValueByKey(string((const char *)key.buf, key.len)));
+    UnlockParser(self);
+    PyBuffer_Release(&key);
+    return values;
+}
+
+static PyObject *ParserDirtyRows(ParserObject *self, PyObject *)
+{
+    // dirty_rows(): the rows changed since the last clear_dirty_rows()
+    if (!CheckParser(self))
+        return NULL;
+    LockParser(self);
+    vector<int> rows = self->parser->GetDirtyRows();
+    UnlockParser(self);
+    PyObject *list = PyList_New(rows.size());
+    if (list == NULL)
+        return NULL;
+    for (size_t i = 0; i < rows.size(); i++)
+        PyList_SET_ITEM(list, i, PyLong_FromLong(rows[i]));
+    return list;
+}
+
+static PyObject *ParserClearDirtyRows(ParserObject *self, PyObject *)
+{
+    if (!CheckParser(self))
+        return NULL;
+    LockParser(self);
+    self->parser->ClearDirtyRows();
+    UnlockParser(self);
+    Py_RETURN_NONE;
+}
+
+static PyMethodDef kParserMethods[] = {
+    {"feed", (PyCFunction)ParserFeed, METH_VARARGS, "feed(data): parse the serial data without the GIL"},
+    {"clean_screen_data", (PyCFunction)ParserCleanScreenData, METH_NOARGS, "clean the screen data"},
+    {"size", (PyCFunction)ParserSize, METH_NOARGS, "(height, width) of the screen"},
+    {"chars", (PyCFunction)ParserChars, METH_NOARGS, "memoryview of the chars of the cells"},
+    {"attrs", (PyCFunction)ParserAttrs, METH_NOARGS, "memoryview of the display attributes of the cells"},
+    {"select_page", (PyCFunction)ParserSelectPage, METH_NOARGS, "the selectable page as a tuple"},
+    {"entries", (PyCFunction)ParserEntries, METH_VARARGS, "entries(selectable_only=0): the (key, value, type) of the entries"},
+    {"get_value_by_key", (PyCFunction)ParserGetValueByKey, METH_VARARGS, "the values of a key joined by ';'"},
+    {"dirty_rows", (PyCFunction)ParserDirtyRows, METH_NOARGS, "the rows changed since the last clear_dirty_rows()"},
+    {"clear_dirty_rows", (PyCFunction)ParserClearDirtyRows, METH_NOARGS, "clear the changed rows"},
+    {NULL, NULL, 0, NULL}};
+
+static int PlaneGetBuffer(PlaneObject *self, Py_buffer *view, int flags)
+{
+    if (flags & PyBUF_WRITABLE)
+    {
+        PyErr_SetString(PyExc_BufferError, "the cells are read-only");
+        return -1;
+    }
+    if (self->owner == NULL)
+    {
+        PyErr_SetString(PyExc_BufferError, "the plane has no parser");
+        return -1;
+    }
+    Vt100ScreenParser *parser = self->owner->parser;
+    view->buf = self->attrs ? (void *)parser->GetScreenAttrs() : (void *)parser->GetScreenChars();
+    view->obj = (PyObject *)self;
+    Py_INCREF(self);
+    view->itemsize = self->strides[1];
+    view->len = self->shape[0] * self->strides[0];
+    view->readonly = 1;
+    view->ndim = 2;
+    view->format = (flags & PyBUF_FORMAT) ? (char *)(self->attrs ? "H" : "B") : NULL;
+    view->shape = (flags & PyBUF_ND) ? self->shape : NULL;
+    view->strides = ((flags & PyBUF_STRIDES) == PyBUF_STRIDES) ? self->strides : NULL;
+    view->suboffsets = NULL;
+    view->internal = NULL;
+    if (view->shape == NULL)
+        view->ndim = 1;
+    return 0;
+}
+
+static void PlaneDealloc(PlaneObject *self)
+{
+    PyTypeObject *type = Py_TYPE(self);
+    Py_XDECREF(self->owner);
+    PyObject_Del(self);
+    Py_DECREF(type);
+}
+
+static PyType_Slot kParserSlots[] = {
+    {Py_tp_doc, (void *)"Parser(platform='client'): the screen of one console"},
+    {Py_tp_new, (void *)PyType_GenericNew},
+    {Py_tp_init, (void *)ParserInit},
+    {Py_tp_dealloc, (void *)ParserDealloc},
+    {Py_tp_methods, (void *)kParserMethods},
+    {0, NULL}};
+
+static PyType_Spec kParserSpec = {"vt100_screen.Parser", sizeof(ParserObject), 0, Py_TPFLAGS_DEFAULT, kParserSlots};
+
+// a plane is made by chars() or attrs() only
+static PyType_Slot kPlaneSlots[] = {
+    {Py_tp_dealloc, (void *)PlaneDealloc},
+    {Py_bf_getbuffer, (void *)PlaneGetBuffer},
+    {0, NULL}};
+
+#ifdef Py_TPFLAGS_DISALLOW_INSTANTIATION
+static PyType_Spec kPlaneSpec = {"vt100_screen.Plane", sizeof(PlaneObject), 0, Py_TPFLAGS_DEFAULT | Py_TPFLAGS_DISALLOW_INSTANTIATION, kPlaneSlots};
+#else
+static PyType_Spec kPlaneSpec = {"vt100_screen.Plane", sizeof(PlaneObject), 0, Py_TPFLAGS_DEFAULT, kPlaneSlots};
+#endif
+
+static PyModuleDef kModule = {PyModuleDef_HEAD_INIT, "vt100_screen", "parse the BIOS screen from the serial data", -1,
+                              NULL, NULL, NULL, NULL, NULL};
+
+PyMODINIT_FUNC PyInit_vt100_screen()
+{
+    ParserType = (PyTypeObject *)PyType_FromSpec(&kParserSpec);
+    if (ParserType == NULL)
+        return NULL;
+    PlaneType = (PyTypeObject *)PyType_FromSpec(&kPlaneSpec);
+    if (PlaneType == NULL)
+        return NULL;
+
+    PyObject *module = PyModule_Create(&kModule);
+    if (module == NULL)
+        return NULL;
+    Py_INCREF(ParserType);
+    if (PyModule_AddObject(module, "Parser", (PyObject *)ParserType) < 0)
+    {
+        Py_DECREF(ParserType);
+        Py_DECREF(module);
+        return NULL;
+    }
+    return module;
+}
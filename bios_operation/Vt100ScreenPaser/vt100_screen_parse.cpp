@@ -9,7 +9,19 @@ Description : This file is designed to analyze and draw the bios screen.
 #define DLLEXPORT extern "C" __declspec(dllexport)
 #endif
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <vector>
 
@@ -18,66 +30,406 @@ Description : This file is designed to analyze and draw the bios screen.
 
 using namespace std;
 
-SelectPage select_page;
-ScreenStruct screen;
-Vt100ScreenParser *vt100_screen_parser = NULL;
-WholePage whole_page;
-char temp_value[1000];
-char *edk_shell_string = NULL;
-
 ScreenItem::ScreenItem()
 {
-    content_ = "";
     beg_ = -1;
     end_ = -1;
-    fg_color_ = FG_DEFAULT;
-    bg_color_ = BG_DEFAULT;
-    text_atr_ = TEXT_DEFAULT;
+    attr_ = CELL_ATTR(FG_DEFAULT, BG_DEFAULT, TEXT_DEFAULT);
 }
 
-ScreenItem::ScreenItem(std::string content, int beg, int end, int fg_color, int bg_color, int text_atr)
+ScreenItem::ScreenItem(int beg, int end, CellAttr attr)
 {
-    content_ = content;
     beg_ = beg;
     end_ = end;
-    fg_color_ = fg_color;
-    bg_color_ = bg_color;
-    text_atr_ = text_atr;
+    attr_ = attr;
 }
 
 void ScreenItem::print()
 {
-    cout << "({" << content_ << "},{" << beg_ << "},{" << end_ << "},{" << fg_color_ << "},{" << bg_color_ << "},{" << text_atr_ << "})" << endl;
+    cout << "({" << beg_ << "},{" << end_ << "},{" << CELL_FG(attr_) << "},{" << CELL_BG(attr_) << "},{" << CELL_TEXT(attr_) << "})" << endl;
+}
+
+// the whitespace matched by \s of the regex, except ' '
+static inline bool IsLineBreak(char ch)
+{
+    return ch == '\t' || ch == '\n' || ch == '\v' || ch == '\f' || ch == '\r';
+}
+
+LineMatcher::LineMatcher(int shape, char left, char right, char mark, int count)
+{
+    shape_ = shape;
+    left_ = left;
+    right_ = right;
+    mark_ = mark;
+    count_ = count;
+}
+
+bool LineMatcher::Find(const string &row, int from, FrameBorder *match) const
+{
+    /*
+        the lines were the regexes below, the match is the whole match of the
+        regex and the mark is its first group
+        LINE_DASHES       -{count_}
+        LINE_BORDER       ^L-*R$
+        LINE_OPEN_BORDER  ^L-+(.*)-+R$
+        LINE_BOX_BORDER   L-+(M?)-+R
+        LINE_PIPES        \|(.*)\|
+        LINE_TITLE         +([\S ]+[\S]) +
+        LINE_BOX_TITLE    ^\| *([\S ]+[\S]) *\|$
+        '.' is any char except '\n' and '\r'
+    */
+    const char *chars = row.data();
+    int len = (int)row.size();
+    int beg = -1;
+    int end = -1;
+    char mark = '\0';
+    switch (shape_)
+    {
+    case LINE_DASHES:
+        for (int i = from, run = 0; i < len; i++)
+        {
+            run = chars[i] == '-' ? run + 1 : 0;
+            if (run == count_)
+            {
+                beg = i + 1 - count_;
+                end = i + 1;
+                break;
+            }
+        }
+        break;
+    case LINE_BORDER:
+        if (from == 0 && len >= 2 && chars[0] == left_ && chars[len - 1] == right_ &&
+            (int)row.find_first_not_of('-', 1) == len - 1)
+        {
+            beg = 0;
+            end = len;
+        }
+        break;
+    case LINE_OPEN_BORDER:
+        if (from == 0 && len >= 4 && chars[0] == left_ && chars[1] == '-' && chars[len - 2] == '-' &&
+            chars[len - 1] == right_ && row.find_first_of("\r\n", 2) >= (size_t)len - 2)
+        {
+            beg = 0;
+            end = len;
+        }
+        break;
+    case LINE_BOX_BORDER:
+        for (int i = from; i < len && beg < 0; i++)
+        {
+            if (chars[i] != left_)
+                continue;
+            int dash = i + 1;
+            while (dash < len && chars[dash] == '-')
+                dash++;
+            if (dash == i + 1 || dash == len)
+                continue;
+            if (mark_ != '\0' && chars[dash] == mark_)
+            {
+                // the mark has '-' on both sides
+                int tail = dash + 1;
+                while (tail < len && chars[tail] == '-')
+                    tail++;
+                if (tail > dash + 1 && tail < len && chars[tail] == right_)
+                {
+                    beg = i;
+                    end = tail + 1;
+                    mark = mark_;
+                }
+            }
+            else if (dash >= i + 3 && chars[dash] == right_)
+            {
+                beg = i;
+                end = dash + 1;
+            }
+        }
+        break;
+    case LINE_PIPES:
+        for (int i = from; i < len && beg < 0; i++)
+        {
+            if (chars[i] != '|')
+                continue;
+            // the last '|' before the end of the line
+            for (int j = i + 1; j < len && chars[j] != '\r' && chars[j] != '\n'; j++)
+            {
+                if (chars[j] == '|')
+                {
+                    beg = i;
+                    end = j + 1;
+                }
+            }
+        }
+        break;
+    case LINE_TITLE:
+        for (int i = from; i < len && beg < 0;)
+        {
+            if (chars[i] != ' ')
+            {
+                i++;
+                continue;
+            }
+            int spaces = i;
+            while (spaces < len && chars[spaces] == ' ')
+                spaces++;
+            int line_end = spaces;
+            while (line_end < len && !IsLineBreak(chars[line_end]))
+                line_end++;
+            // the title is [spaces, last], its last char is followed by ' '
+            int last = -1;
+            for (int j = line_end - 2; j > spaces && last < 0; j--)
+            {
+                if (chars[j] != ' ' && chars[j + 1] == ' ')
+                    last = j;
+            }
+            // a one char title only if the spaces before it are two at least
+            if (last < 0 && spaces - i >= 2 && spaces + 1 < len && chars[spaces] != ' ' &&
+                !IsLineBreak(chars[spaces]) && chars[spaces + 1] == ' ')
+                last = spaces;
+            if (last >= 0)
+            {
+                beg = i;
+                end = last + 1;
+                while (end < len && chars[end] == ' ')
+                    end++;
+            }
+            i = spaces;
+        }
+        break;
+    case LINE_BOX_TITLE:
+        if (from == 0 && len >= 2 && chars[0] == '|' && chars[len - 1] == '|')
+        {
+            int last = len - 2;
+            while (last > 0 && chars[last] == ' ')
+                last--;
+            bool title = last >= 2;
+            for (int i = 1; i <= last && title; i++)
+                title = !IsLineBreak(chars[i]);
+            if (title)
+            {
+                beg = 0;
+                end = len;
+            }
+        }
+        break;
+    }
+    if (beg < 0)
+        return false;
+    if (match != NULL)
+    {
+        match->beg_ = beg;
+        match->end_ = end;
+        match->mark_ = mark;
+    }
+    return true;
+}
+
+TextView::TextView()
+{
+    data_ = "";
+    len_ = 0;
+}
+
+TextView::TextView(const char *data, int len)
+{
+    data_ = data;
+    len_ = len;
+}
+
+TextView::TextView(const string &str)
+{
+    data_ = str.data();
+    len_ = (int)str.size();
+}
+
+TextView TextView::Sub(int beg, int len) const
+{
+    beg = min(beg, len_);
+    if (len < 0 || len > len_ - beg)
+        len = len_ - beg;
+    return TextView(data_ + beg, len);
+}
+
+TextView TextView::Strip() const
+{
+    int beg = 0;
+    while (beg < len_ && data_[beg] == ' ')
+        beg++;
+    return TextView(data_ + beg, len_ - beg).RStrip();
+}
+
+TextView TextView::RStrip() const
+{
+    int len = len_;
+    while (len > 0 && data_[len - 1] == ' ')
+        len--;
+    return TextView(data_, len);
+}
+
+bool TextView::Empty() const
+{
+    return len_ == 0;
+}
+
+int TextView::Find(char ch, int beg) const
+{
+    for (int i = beg; i < len_; i++)
+    {
+        if (data_[i] == ch)
+            return i;
+    }
+    return -1;
+}
+
+int TextView::Find(TextView text, int beg) const
+{
+    if (beg > len_)
+        return -1;
+    const char *found = std::search(data_ + beg, data_ + len_, text.data_, text.data_ + text.len_);
+    if (found == data_ + len_ && text.len_ > 0)
+        return -1;
+    return found - data_;
+}
+
+bool TextView::StartsWith(const char *prefix) const
+{
+    int len = strlen(prefix);
+    return len <= len_ && memcmp(data_, prefix, len) == 0;
+}
+
+bool TextView::EndsWith(const char *suffix) const
+{
+    int len = strlen(suffix);
+    return len <= len_ && memcmp(data_ + len_ - len, suffix, len) == 0;
+}
+
+bool TextView::operator==(const TextView &other) const
+{
+    return len_ == other.len_ && memcmp(data_, other.data_, len_) == 0;
+}
+
+bool TextView::operator!=(const TextView &other) const
+{
+    return !(*this == other);
+}
+
+void TextArena::Reset()
+{
+    chars_.clear();
+}
+
+int TextArena::Size() const
+{
+    return (int)chars_.size();
+}
+
+void TextArena::Assign(const TextArena &other, int len)
+{
+    chars_.assign(other.chars_, 0, len);
+}
+
+void TextArena::Swap(TextArena &other)
+{
+    chars_.swap(other.chars_);
+}
+
+TextSpan TextArena::Append(TextView text)
+{
+    TextSpan span = {(int)chars_.size(), text.len_};
+    chars_.append(text.data_, text.len_);
+    return span;
+}
+
+TextSpan TextArena::Join(TextSpan head, TextView tail)
+{
+    // the head is copied to the end unless it is the last span
+    if (head.beg_ + head.len_ != (int)chars_.size())
+    {
+        chars_.reserve(chars_.size() + head.len_ + tail.len_);
+        int beg = (int)chars_.size();
+        chars_.append(chars_, head.beg_, head.len_);
+        head.beg_ = beg;
+    }
+    chars_.append(tail.data_, tail.len_);
+    head.len_ += tail.len_;
+    return head;
+}
+
+TextView TextArena::View(TextSpan span) const
+{
+    return TextView(chars_.data() + span.beg_, span.len_);
+}
+
+// names of the display attributes, indexed by the code - FG_BASE, the
+// code - BG_BASE and the text attribute code, NULL if not supported
+static constexpr const char *kFgName[] = {"black", "red", "green", "brown", "blue", "magenta", "cyan", "white", NULL, "default"}; // default: white.
+static constexpr const char *kBgName[] = {"black", "red", "green", "brown", "blue", "magenta", "cyan", "white", NULL, "default"}; // default: black.
+static constexpr const char *kTextName[] = {
+    "default", "+bold", NULL, "+italics", "+underscore", NULL, NULL, "+reverse", NULL, "+strikethrough",
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL,
+    NULL, NULL, "-bold", "-italics", "-underscore", NULL, NULL, "-reverse", NULL, "-strikethrough"};
+
+static const char *AttributeName(const char *const names[], int count, int index)
+{
+    return (index >= 0 && index < count) ? names[index] : NULL;
 }
 
-ScreenCell::ScreenCell()
+static const char *FgName(int fg)
 {
-    content_ = ' ';
-    fg_color_ = FG_DEFAULT;
-    bg_color_ = BG_DEFAULT;
-    text_atr_ = TEXT_DEFAULT;
+    return AttributeName(kFgName, sizeof(kFgName) / sizeof(kFgName[0]), fg - FG_BASE);
 }
 
-ScreenCell::ScreenCell(char content, int fg_color, int bg_color, int text_atr)
+static const char *BgName(int bg)
 {
-    content_ = content;
-    fg_color_ = fg_color;
-    bg_color_ = bg_color;
-    text_atr_ = text_atr;
+    return AttributeName(kBgName, sizeof(kBgName) / sizeof(kBgName[0]), bg - BG_BASE);
 }
 
-void ScreenCell::print()
+static const char *TextName(int text)
 {
-    cout << "({" << content_ << "},{" << fg_color_ << "},{" << bg_color_ << "},{" << text_atr_ << "})" << endl;
+    return AttributeName(kTextName, sizeof(kTextName) / sizeof(kTextName[0]), text);
 }
 
-int Vt100ScreenParser::String2Num(std::string str, int widthOrheight)
+static int AttributeCode(const char *const names[], int count, int base, const char *name)
+{
+    for (int i = 0; i < count; i++)
+    {
+        if (names[i] != NULL && strcmp(names[i], name) == 0)
+            return base + i;
+    }
+    return -1;
+}
+
+static int FgCode(const char *name)
+{
+    return AttributeCode(kFgName, sizeof(kFgName) / sizeof(kFgName[0]), FG_BASE, name);
+}
+
+static int BgCode(const char *name)
+{
+    return AttributeCode(kBgName, sizeof(kBgName) / sizeof(kBgName[0]), BG_BASE, name);
+}
+
+static int TextCode(const char *name)
+{
+    return AttributeCode(kTextName, sizeof(kTextName) / sizeof(kTextName[0]), 0, name);
+}
+
+// the bits of the cells [beg, end) in the word-th word of a row mask
+static uint64_t RowMaskBits(int word, int beg, int end)
+{
+    int lo = max(beg, word * 64) - word * 64;
+    int hi = min(end, word * 64 + 64) - word * 64;
+    if (lo >= hi)
+        return 0;
+    uint64_t bits = (hi - lo == 64) ? ~(uint64_t)0 : (((uint64_t)1 << (hi - lo)) - 1);
+    return bits << lo;
+}
+
+int Vt100ScreenParser::ParamToNum(short param, bool from_end, int widthOrheight)
 {
     // if width == 100, ":0" represents 100, ":1" represents 99
-    if (str[0] == ':')
-        return widthOrheight - atoi(str.substr(1, str.length() - 1).c_str());
+    if (from_end)
+        return widthOrheight - param;
     else
-        return atoi(str.c_str());
+        return param;
 }
 
 int Vt100ScreenParser::GetWidth()
@@ -104,19 +456,23 @@ int Vt100ScreenParser::GetHeight()
     return height_;
 }
 
-string Vt100ScreenParser::GetRowContent(int row_no)
+const char *Vt100ScreenParser::GetScreenChars()
+{
+    return screen_chars_.data();
+}
+
+const CellAttr *Vt100ScreenParser::GetScreenAttrs()
+{
+    return screen_attrs_.data();
+}
+
+const string &Vt100ScreenParser::GetRowContent(int row_no)
 {
     /*
-     get whole row content text
+     get whole row content text, it is kept by MergeScreenInfo() and is
+     valid until the next merge, copy it if it is kept longer
     */
-    string content = "";
-    vector<ScreenItem> row = screen_info_[row_no];
-    for (auto it = row.begin(); it != row.end(); it++)
-    {
-        ScreenItem screen_item = *it;
-        content += screen_item.content_;
-    }
-    return content;
+    return row_content_[row_no];
 }
 
 vector<string> Vt100ScreenParser::GetWholePage()
@@ -135,10 +491,10 @@ vector<string> Vt100ScreenParser::GetWholePage()
                               ]
     */
     vector<string> page;
+    UpdateScreenInfo();
     for (int i = 0; i < height_; i++)
     {
-        string content = GetRowContent(i);
-        page.push_back(content);
+        page.push_back(GetRowContent(i));
     }
     return page;
 }
@@ -152,19 +508,19 @@ bool Vt100ScreenParser::CheckRowFgBgText(int idx, int fg, int bg, int text, int
     */
     if (end == -1)
         end = width_;
-    vector<ScreenItem> screen_info_idx = screen_info_[idx];
+    const vector<ScreenItem> &screen_info_idx = screen_info_[idx];
     if (screen_info_idx.size() == 0)
         return false;
     for (auto it = screen_info_idx.begin(); it != screen_info_idx.end(); it++)
     {
-        ScreenItem screen_item = *it;
+        const ScreenItem &screen_item = *it;
         if (screen_item.beg_ < end && screen_item.end_ > beg)
         {
-            if (fg != -1 && screen_item.fg_color_ != fg)
+            if (fg != -1 && CELL_FG(screen_item.attr_) != fg)
                 return false;
-            else if (bg != -1 && screen_item.bg_color_ != bg)
+            else if (bg != -1 && CELL_BG(screen_item.attr_) != bg)
                 return false;
-            else if (text != -1 && screen_item.text_atr_ != text)
+            else if (text != -1 && CELL_TEXT(screen_item.attr_) != text)
                 return false;
         }
     }
@@ -181,72 +537,91 @@ bool Vt100ScreenParser::CheckExistRowFgBgText(int idx, int fg, int bg, int text,
     */
     if (end == -1)
         end = width_;
-    vector<ScreenItem> screen_item_info = screen_info_[idx];
+    const vector<ScreenItem> &screen_item_info = screen_info_[idx];
+    const char *chars = row_content_[idx].data();
     for (auto it = screen_item_info.begin(); it != screen_item_info.end(); it++)
     {
-        ScreenItem screen_item = *it;
+        const ScreenItem &screen_item = *it;
         if (screen_item.beg_ < end && screen_item.end_ > beg)
         {
-            bool fg_flag = true;
-            bool bg_flag = true;
-            bool text_flag = true;
-            string non_whitespace_flag = "true";
-            if (fg != -1 && screen_item.fg_color_ != fg)
-                fg_flag = false;
-            if (bg != -1 && screen_item.bg_color_ != bg)
-                bg_flag = false;
-            if (text != -1 && screen_item.text_atr_ != text)
-                text_flag = false;
-            if (non_whitespace == true)
+            if (fg != -1 && CELL_FG(screen_item.attr_) != fg)
+                continue;
+            if (bg != -1 && CELL_BG(screen_item.attr_) != bg)
+                continue;
+            if (text != -1 && CELL_TEXT(screen_item.attr_) != text)
+                continue;
+            if (non_whitespace == false)
+                return true;
+            // the part of the run in row[beg:end] has a char other than ' '
+            int max_beg = max(beg, screen_item.beg_);
+            int min_end = min(end, screen_item.end_);
+            for (int i = max_beg; i < min_end; i++)
             {
-                int max_beg = max(0, beg - screen_item.beg_);
-                int min_end = min(end, screen_item.end_) - screen_item.beg_;
-                string content_no_strip = screen_item.content_.substr(max_beg, min_end - max_beg);
-                if (content_no_strip.empty())
-                    non_whitespace_flag = content_no_strip;
-                else
-                {
-                    content_no_strip.erase(0, content_no_strip.find_first_not_of(" "));
-                    content_no_strip.erase(content_no_strip.find_last_not_of(" ") + 1);
-                    non_whitespace_flag = content_no_strip;
-                }
+                if (chars[i] != ' ')
+                    return true;
             }
-            if (fg_flag == true && bg_flag == true && text_flag == true && non_whitespace_flag != "")
-                return true;
         }
     }
     return false;
 }
 
+bool Vt100ScreenParser::CheckExistRole(int role, int idx, int beg, int end, bool non_whitespace)
+{
+    /*
+        Same as CheckExistRowFgBgText() with the colors of the role, it is
+        answered by the row masks instead of the runs of screen_info_.
+    */
+    if (end == -1 || end > width_)
+        end = width_;
+    const RowMasks &masks = row_masks_[idx];
+    for (int i = 0; i < ROW_MASK_WORDS; i++)
+    {
+        uint64_t bits = masks.role_[role][i] & RowMaskBits(i, beg, end);
+        if (non_whitespace)
+            bits &= masks.non_blank_[i];
+        if (bits != 0)
+            return true;
+    }
+    return false;
+}
+
 bool Vt100ScreenParser::CheckExistDisable(int idx, int beg, int end, bool non_whitespace)
 {
-    bool check_exist_disable = CheckExistRowFgBgText(idx, disable_fg_, disable_bg_, disable_text_, beg, end, non_whitespace);
+    bool check_exist_disable = CheckExistRole(CELL_ROLE_DISABLE, idx, beg, end, non_whitespace);
     return check_exist_disable;
 }
 
 bool Vt100ScreenParser::CheckExistSubtitle(int idx, int beg, int end, bool non_whitespace)
 {
-    bool check_exist_subtitle = CheckExistRowFgBgText(idx, subtitle_fg_, subtitle_bg_, -1, beg, end, non_whitespace);
+    bool check_exist_subtitle = CheckExistRole(CELL_ROLE_SUBTITLE, idx, beg, end, non_whitespace);
     return check_exist_subtitle;
 }
 
 bool Vt100ScreenParser::CheckExistHighlight(int idx, int beg, int end, bool non_whitespace)
 {
-    bool check_exist_highlight = CheckExistRowFgBgText(idx, highlight_fg_, highlight_bg_, -1, beg, end, non_whitespace);
+    bool check_exist_highlight = CheckExistRole(CELL_ROLE_HIGHLIGHT, idx, beg, end, non_whitespace);
     return check_exist_highlight;
 }
 
 bool Vt100ScreenParser::CheckExistHighlightPopup(int idx, int beg, int end, bool non_whitespace)
 {
-    bool check_exist_highlight_popup = CheckExistRowFgBgText(idx, highlight_popup_fg_, highlight_popup_bg_, -1, beg, end, true);
+    // the popup highlight is looked for in the non-blank cells only
+    (void)non_whitespace;
+    bool check_exist_highlight_popup = CheckExistRole(CELL_ROLE_HIGHLIGHT_POPUP, idx, beg, end, true);
     return check_exist_highlight_popup;
 }
 
+bool Vt100ScreenParser::CheckExistSelectable(int idx, int beg, int end, bool non_whitespace)
+{
+    bool check_exist_selectable = CheckExistRole(CELL_ROLE_SELECTABLE, idx, beg, end, non_whitespace);
+    return check_exist_selectable;
+}
+
 bool Vt100ScreenParser::IsScrollableUp()
 {
     // check if ^ exist after header, and in color page_fg, page_bg
     int row_no = workspace_beg_;
-    string content = GetRowContent(row_no);
+    const string &content = GetRowContent(row_no);
     string::size_type idx = content.find(scroll_up_char_);
     // find scroll_up_char_
     if (idx != string::npos)
@@ -260,7 +635,7 @@ bool Vt100ScreenParser::IsScrollableUp()
 bool Vt100ScreenParser::IsScrollableDown()
 {
     int row_no = workspace_end_ - 1;
-    string content = GetRowContent(row_no);
+    const string &content = GetRowContent(row_no);
     string::size_type idx = content.find(scroll_down_char_);
     if (idx != string::npos)
     {
@@ -274,8 +649,6 @@ void Vt100ScreenParser::InitWorkspace()
 {
     workspace_beg_ = header_end_;
     workspace_end_ = footer_beg_;
-    if (workspace_beg_ >= workspace_end_)
-        cout << "no workspace" << endl;
 }
 
 void Vt100ScreenParser::InitFooter()
@@ -287,17 +660,16 @@ void Vt100ScreenParser::InitFooter()
         if not matched, match black bg
     */
     bool bottom_set = false;
+    footer_rows_beg_ = height_;
     for (int idx = height_ - 1; idx >= 0; idx--)
     {
-        string content = GetRowContent(idx);
+        footer_rows_beg_ = idx;
         if (bottom_set == false)
         {
+            // footer bottom not matched, change scheme to match color
             if (idx < footer_beg_)
-            {
-                cout << "footer bottom not matched, change scheme to match color." << endl;
                 break;
-            }
-            bool match = regex_match(content, *footer_regex_bottom_);
+            bool match = row_frames_[idx].footer_bottom_;
             if (match == true)
             {
                 footer_end_ = idx + 1;
@@ -306,12 +678,10 @@ void Vt100ScreenParser::InitFooter()
         }
         else
         {
+            // footer begin not found in 5 lines before footer end, use default
             if (idx < footer_end_ - 5)
-            {
-                cout << "footer begin not found in 5 lines before footer end, use default." << endl;
                 break;
-            }
-            bool match = regex_match(content, *footer_regex_top_);
+            bool match = row_frames_[idx].footer_top_;
             if (match == true)
             {
                 footer_beg_ = idx;
@@ -325,12 +695,11 @@ void Vt100ScreenParser::InitFooter()
         {
             if (bottom_set == false)
             {
+                // footer not found, use default config
                 if (idx < footer_beg_)
-                {
-                    cout << "footer not found, use default config" << endl;
                     break;
-                }
                 bool check_row_fg_bg_text = CheckRowFgBgText(idx, -1, home_footer_bg_, -1, 0, -1);
+                footer_rows_beg_ = min(footer_rows_beg_, idx);
                 if (check_row_fg_bg_text == true)
                 {
                     bottom_set = true;
@@ -339,12 +708,11 @@ void Vt100ScreenParser::InitFooter()
             }
             else
             {
+                // footer begin not found in 7 lines before footer end, use default
                 if (idx < footer_end_ - 7)
-                {
-                    cout << "footer begin not found in 7 lines begfore footer end, use default" << endl;
                     break;
-                }
                 bool check_row_fg_bg_text = CheckRowFgBgText(idx, -1, home_footer_bg_, -1, 1, width_ - 1);
+                footer_rows_beg_ = min(footer_rows_beg_, idx);
                 if (check_row_fg_bg_text == true)
                     continue;
                 else
@@ -366,55 +734,50 @@ void Vt100ScreenParser::InitHeader(Vt100ScreenParser::Page &page_ret)
         if not matched set to default [0, 6).
         Then match \--------/ for header_end at row header_beg + 2.
     */
-    string title = "";
+    TextView title;
     int search_beg = header_beg_;
     int search_end = header_end_;
+    header_rows_end_ = search_beg;
     // header may not start from the first row
     for (int i = search_beg; i < search_end; i++)
     {
-        string top = GetRowContent(i);
-        bool top_match = regex_search(top, *header_regex_top_);
+        bool top_match = row_frames_[i].header_top_;
+        header_rows_end_ = max(header_rows_end_, i + 1);
         if (top_match == true)
         {
             header_beg_ = i;
-            string mid = GetRowContent(i + 1);
-            smatch mid_match_result;
-            bool mid_match = regex_search(mid, mid_match_result, *header_regex_mid_);
+            header_rows_end_ = max(header_rows_end_, i + 3);
+            const string &mid = GetRowContent(i + 1);
+            FrameBorder mid_match_result;
+            bool mid_match = header_line_mid_.Find(mid, 0, &mid_match_result);
             if (mid_match == true)
-            {
-                title = mid_match_result[0];
-                // strip
-                title.erase(0, title.find_first_not_of(" "));
-                title.erase(title.find_last_not_of(" ") + 1);
-            }
-            else
-                cout << "no title after header top, leave it None" << endl;
-            string bottom = GetRowContent(i + 2);
-            bool bottom_match = regex_search(bottom, *header_regex_bottom_);
+                title = TextView(mid).Sub(mid_match_result.beg_, mid_match_result.end_ - mid_match_result.beg_).Strip();
+            // no title after header top, leave it None
+            bool bottom_match = row_frames_[i + 2].header_bottom_;
             if (bottom_match == true)
             {
                 header_end_ = i + 3;
                 break;
             }
-            else
-                cout << "header has no bottom, use default" << endl;
+            // header has no bottom, use default
         }
     }
-    page_ret.titles = title;
-    cout << "page title is " << title << endl;
+    page_ret.titles.assign(title.data_, title.len_);
 }
 
-string ParseWithoutEsc(string byte_input, vector<Vt100Cmd> &events)
+string ParseWithoutEsc(const string &byte_input, vector<Vt100Cmd> &events)
 {
     /*
         If an input not start with \x1b take it as draw string cmd
-        append to events, return the left bytes start with \x1b
+        append to events, return the left bytes start with \x1b.
+        The draw cmd refers to byte_input.
     */
     int idx = byte_input.find(VT100_ESC);
+    Vt100Cmd draw(VT100_CMD_DRAW);
     if (idx > 0)
     {
-        vector<string> draw_content = {byte_input.substr(0, idx)};
-        events.push_back(Vt100Cmd("draw", draw_content));
+        draw.length_ = idx;
+        events.push_back(draw);
         string content_after_idx = byte_input.substr(idx, byte_input.size() - idx);
         return content_after_idx;
     }
@@ -422,13 +785,13 @@ string ParseWithoutEsc(string byte_input, vector<Vt100Cmd> &events)
         return byte_input;
     else
     {
-        vector<string> draw_content = {byte_input};
-        events.push_back(Vt100Cmd("draw", draw_content));
+        draw.length_ = byte_input.size();
+        events.push_back(draw);
         return "";
     }
 }
 
-Vt100ScreenParser::Vt100ScreenParser(std::string platform)
+Vt100ScreenParser::Vt100ScreenParser(std::string platform) : edk_shell_screen_(true)
 {
     if (platform != "client" && platform != "server")
     {
@@ -441,26 +804,27 @@ Vt100ScreenParser::Vt100ScreenParser(std::string platform)
     cur_fg_ = FG_DEFAULT;
     cur_bg_ = BG_DEFAULT;
     cur_text_attribute_ = TEXT_DEFAULT;
+    cur_row_ = -1;
+    cur_col_ = -1;
     buff_.clear();
-    FG = FG_ANSI;
-    BG = BG_ANSI;
-    TEXT = TEXT_ANSI;
-
-    FG_INV.clear();
-    for (auto it = FG.begin(); it != FG.end(); it++)
-        FG_INV.insert(make_pair(it->second, it->first));
-
-    BG_INV.clear();
-    for (auto it = BG.begin(); it != BG.end(); it++)
-        BG_INV.insert(make_pair(it->second, it->first));
-
-    TEXT_INV.clear();
-    for (auto it = TEXT.begin(); it != TEXT.end(); it++)
-        TEXT_INV.insert(make_pair(it->second, it->first));
+    generation_ = 0;
+    held_drawn_ = false;
+    record_generation_ = 0;
+    record_format_ = PAGE_RECORD_JSON;
+    record_flags_ = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        page_cache_[i / 2][i % 2].generation = 0;
+        page_cache_[i / 2][i % 2].entry_beg = -1;
+        page_cache_[i / 2][i % 2].index.generation = 0;
+        page_cache_[i / 2][i % 2].index.has_trigrams = false;
+    }
 
     InitPlatformConfig();
     InitCharMatrix();
     InitScreenInfo();
+    // the default patterns are used if there is no config file
+    LoadNoiseFilter(DEFAULT_NOISE_FILTER_CONFIG_FILE);
 }
 
 void Vt100ScreenParser::InitPlatformConfig()
@@ -470,24 +834,24 @@ void Vt100ScreenParser::InitPlatformConfig()
         width_ = 100;
         height_ = 31;
 
-        highlight_fg_ = FG_INV["white"];
-        highlight_bg_ = BG_INV["black"];
+        highlight_fg_ = FgCode("white");
+        highlight_bg_ = BgCode("black");
 
-        highlight_popup_fg_ = FG_INV["white"];
-        highlight_popup_bg_ = BG_INV["cyan"];
+        highlight_popup_fg_ = FgCode("white");
+        highlight_popup_bg_ = BgCode("cyan");
 
-        page_fg_ = FG_INV["red"];
-        page_bg_ = BG_INV["white"];
-        selectable_fg_ = FG_INV["blue"];
-        selectable_bg_ = BG_INV["white"];
-        disable_fg_ = FG_INV["black"];
-        disable_bg_ = BG_INV["white"];
-        disable_text_ = TEXT_INV["+bold"];
+        page_fg_ = FgCode("red");
+        page_bg_ = BgCode("white");
+        selectable_fg_ = FgCode("blue");
+        selectable_bg_ = BgCode("white");
+        disable_fg_ = FgCode("black");
+        disable_bg_ = BgCode("white");
+        disable_text_ = TextCode("+bold");
 
-        default_bg_ = BG_INV["white"];
-        home_footer_bg_ = BG_INV["black"];
-        subtitle_fg_ = FG_INV["black"];
-        subtitle_bg_ = BG_INV["white"];
+        default_bg_ = BgCode("white");
+        home_footer_bg_ = BgCode("black");
+        subtitle_fg_ = FgCode("black");
+        subtitle_bg_ = BgCode("white");
 
         header_beg_ = 0;
         header_end_ = 6;
@@ -501,40 +865,39 @@ void Vt100ScreenParser::InitPlatformConfig()
         scroll_down_char_ = 'v';
         scroll_up_char_ = '^';
 
-        header_regex_top_ = new std::regex("-{10}");
-        header_regex_mid_ = new std::regex(" +([\\S ]+[\\S]) +");
-        header_regex_bottom_ = new std::regex("-{10}");
-        footer_regex_top_ = new std::regex("^\\/-*\\\\$");
-        footer_regex_mid_ = new std::regex("^\\| *([\\S ]+[\\S]) *\\|$");
-        footer_regex_bottom_ = new std::regex("^\\\\-*\\/$");
-        popup_regex_top_ = new std::regex("\\/-+(\\^?)-+\\\\");
-        popup_regex_mid_ = new std::regex("\\|(.*)\\|");
-        popup_regex_bottom_ = new std::regex("\\\\-+(v?)-+\\/");
+        header_line_top_ = LineMatcher(LINE_DASHES, '\0', '\0', '\0', 10);
+        header_line_mid_ = LineMatcher(LINE_TITLE);
+        header_line_bottom_ = LineMatcher(LINE_DASHES, '\0', '\0', '\0', 10);
+        footer_line_top_ = LineMatcher(LINE_BORDER, '/', '\\');
+        footer_line_bottom_ = LineMatcher(LINE_BORDER, '\\', '/');
+        popup_line_top_ = LineMatcher(LINE_BOX_BORDER, '/', '\\', scroll_up_char_);
+        popup_line_mid_ = LineMatcher(LINE_PIPES);
+        popup_line_bottom_ = LineMatcher(LINE_BOX_BORDER, '\\', '/', scroll_down_char_);
     }
     else
     {
         width_ = 80;
         height_ = 25;
 
-        highlight_fg_ = FG_INV["white"];
-        highlight_bg_ = BG_INV["black"];
+        highlight_fg_ = FgCode("white");
+        highlight_bg_ = BgCode("black");
 
-        highlight_popup_fg_ = FG_INV["white"];
-        highlight_popup_bg_ = BG_INV["cyan"];
+        highlight_popup_fg_ = FgCode("white");
+        highlight_popup_bg_ = BgCode("cyan");
 
-        page_fg_ = FG_INV["red"];
-        page_bg_ = BG_INV["white"];
+        page_fg_ = FgCode("red");
+        page_bg_ = BgCode("white");
 
-        selectable_fg_ = FG_INV["black"]; //
-        selectable_bg_ = BG_INV["white"];
-        disable_fg_ = FG_INV["black"];
-        disable_bg_ = BG_INV["white"];
-        disable_text_ = TEXT_INV["+bold"];
+        selectable_fg_ = FgCode("black"); //
+        selectable_bg_ = BgCode("white");
+        disable_fg_ = FgCode("black");
+        disable_bg_ = BgCode("white");
+        disable_text_ = TextCode("+bold");
 
-        default_bg_ = BG_INV["white"];
-        home_footer_bg_ = BG_INV["black"];
-        subtitle_fg_ = FG_INV["blue"];
-        subtitle_bg_ = BG_INV["white"];
+        default_bg_ = BgCode("white");
+        home_footer_bg_ = BgCode("black");
+        subtitle_fg_ = FgCode("blue");
+        subtitle_bg_ = BgCode("white");
 
         header_beg_ = 0;
         header_end_ = 6;
@@ -548,185 +911,522 @@ void Vt100ScreenParser::InitPlatformConfig()
         scroll_down_char_ = 'v';
         scroll_up_char_ = '^';
 
-        header_regex_top_ = new std::regex("^\\/-*\\\\$");
-        header_regex_mid_ = new std::regex("^\\| *([\\S ]+[\\S]) *\\|$");
-        header_regex_bottom_ = new std::regex("^\\\\-*\\/$");
-        footer_regex_top_ = new std::regex("^\\/-*\\\\$");
-        footer_regex_mid_ = new std::regex("^\\| *([\\S ]+[\\S]) *\\|$");
-        footer_regex_bottom_ = new std::regex("^\\\\-+(.*)-+\\/$");
-        popup_regex_top_ = new std::regex("\\/-+(\\^?)-+\\\\");
-        popup_regex_mid_ = new std::regex("\\|(.*)\\|");
-        popup_regex_bottom_ = new std::regex("\\\\-+(v?)-+\\/");
+        header_line_top_ = LineMatcher(LINE_BORDER, '/', '\\');
+        header_line_mid_ = LineMatcher(LINE_BOX_TITLE);
+        header_line_bottom_ = LineMatcher(LINE_BORDER, '\\', '/');
+        footer_line_top_ = LineMatcher(LINE_BORDER, '/', '\\');
+        footer_line_bottom_ = LineMatcher(LINE_OPEN_BORDER, '\\', '/');
+        popup_line_top_ = LineMatcher(LINE_BOX_BORDER, '/', '\\', scroll_up_char_);
+        popup_line_mid_ = LineMatcher(LINE_PIPES);
+        popup_line_bottom_ = LineMatcher(LINE_BOX_BORDER, '\\', '/', scroll_down_char_);
     }
 }
 
 void Vt100ScreenParser::InitCharMatrix()
 {
-    char_matrix_.clear();
-    char_matrix_.resize(height_);
+    screen_chars_.assign(height_ * width_, ' ');
+    screen_attrs_.assign(height_ * width_, CELL_ATTR(FG_DEFAULT, BG_DEFAULT, TEXT_DEFAULT));
+    row_stale_.assign(height_, true);
+    row_dirty_.assign(height_, true);
+    row_masks_.assign(height_, RowMasks());
     for (int i = 0; i < height_; i++)
-    {
-        char_matrix_[i].clear();
-        char_matrix_[i].resize(width_);
-    }
+        UpdateRowMasks(i, 0, width_, CELL_ATTR(FG_DEFAULT, BG_DEFAULT, TEXT_DEFAULT));
+    generation_++;
+    row_generation_.assign(height_, generation_);
 }
 
 void Vt100ScreenParser::InitScreenInfo()
 {
     screen_info_.clear();
     screen_info_.resize(height_);
+    row_content_.clear();
+    row_content_.resize(height_);
+    row_frames_.clear();
+    row_frames_.resize(height_);
+    screen_info_stale_ = false;
 }
 
 void Vt100ScreenParser::CleanScreenData()
 {
+    held_drawn_ = false;
     InitCharMatrix();
     InitScreenInfo();
+    cur_row_ = -1;
+    cur_col_ = -1;
 }
 
-std::string Vt100ScreenParser::CharReplace(std::string str)
-{
-    // replace unreadable character to readale VT100 terminal format
-    std::unordered_map<char, char> replace_map = {
-        {'\xbf', '\\'},
-        {'\xd9', '/'},
-        {'\xc0', '\\'},
-        {'\xb3', '|'},
-        {'\xc4', '-'},
-        {'\xda', '/'},
-        {'\x10', '>'},
-        {'\x18', '^'},
-        {'\x19', 'v'}};
-    int len = str.length();
-    for (int i = 0; i < len; i++)
+void Vt100ScreenParser::SetSplitEngine(int engine)
+{
+    /*
+       Function Name       : SetSplitEngine()
+       Parameters          : engine: SPLIT_ENGINE_STATE_MACHINE or SPLIT_ENGINE_REGEX
+       Functionality       : select the engine which splits the serial data
+       Function Invoked    : DebugScreen.SetEngine()
+       Return Value        : None
+   */
+    debug_screen_.SetEngine(engine);
+}
+
+bool Vt100ScreenParser::LoadNoiseFilter(const std::string &file)
+{
+    /*
+       Function Name       : LoadNoiseFilter()
+       Parameters          : file: the patterns of the logs printed into the serial data
+       Functionality       : replace the patterns of the noise filter
+       Function Invoked    : DebugScreen.LoadNoiseFilter()
+       Return Value        : false if the file can not be read
+   */
+    ReleaseHeld();
+    if (!debug_screen_.LoadNoiseFilter(file))
+        return false;
+    edk_shell_screen_.SetNoiseFilter(debug_screen_.GetNoiseFilter());
+    return true;
+}
+
+int Vt100ScreenParser::GetNoiseFilterHits(const std::string &pattern)
+{
+    // the logs removed by ParseEdkShell() are counted too
+    int hits = debug_screen_.GetNoiseFilterHits(pattern);
+    return hits != -1 ? hits + edk_shell_screen_.GetNoiseFilterHits(pattern) : -1;
+}
+
+static void ParseEdkShellText(DebugScreen &debug_screen, const char *input, bool remove_ec_logs, string &text)
+{
+    /*
+        Function Name       : parse_edk_shell()
+        Parameters          : debug_screen: an edk shell DebugScreen, the logs of its noise filter are removed
+                              inputs
+        Functionality       : parse the output of EDK/EFI shell serial output
+                              return string
+        Function Invoked    : DebugScreen.serial_output_split()
+        Return Value        : str
+    */
+    vector<Vt100Cmd> events;
+    string esc_parse = ParseWithoutEsc(input, events);
+    // only the data from the first ESC is returned, as before. The input is
+    // the whole output, the end which may start a log is text
+    events.clear();
+    debug_screen.SerialOutputSplit(esc_parse, events, false, remove_ec_logs, true);
+
+    text.clear();
+    for (auto it = events.begin(); it != events.end(); it++)
     {
-        if (replace_map.count(str[i]))
-        {
-            str[i] = replace_map[str[i]];
-        }
+        if (it->op_ == VT100_CMD_DRAW)
+            text.append(debug_screen.GetText(*it, esc_parse.data()), it->length_);
     }
-    return str;
 }
 
-void Vt100ScreenParser::Feed(std::string input)
+void Vt100ScreenParser::ParseEdkShell(const char *input, bool remove_ec_logs, std::string &text)
 {
-    input = CharReplace(input);
-    std::vector<Vt100Cmd> vt100cmds = debug_screen_.SerialOutputSplit(input);
-    buff_.insert(buff_.end(), vt100cmds.begin(), vt100cmds.end());
-    if (!buff_.empty())
+    // every call is parsed from a clean state, as a new DebugScreen would
+    edk_shell_screen_.Reset();
+    ParseEdkShellText(edk_shell_screen_, input, remove_ec_logs, text);
+}
+
+// replace unreadable character to readale VT100 terminal format
+static const char kCharReplace[][2] = {
+    {'\xbf', '\\'},
+    {'\xd9', '/'},
+    {'\xc0', '\\'},
+    {'\xb3', '|'},
+    {'\xc4', '-'},
+    {'\xda', '/'},
+    {'\x10', '>'},
+    {'\x18', '^'},
+    {'\x19', 'v'}};
+
+static const struct CharReplaceTable
+{
+    unsigned char chars[256];
+    CharReplaceTable()
     {
-        ParseScreen();
+        for (int i = 0; i < 256; i++)
+            chars[i] = (unsigned char)i;
+        for (size_t i = 0; i < sizeof(kCharReplace) / sizeof(kCharReplace[0]); i++)
+            chars[(unsigned char)kCharReplace[i][0]] = (unsigned char)kCharReplace[i][1];
     }
-}
+} kCharReplaceTable;
 
-void Vt100ScreenParser::ParseScreen()
+static const char kEcMark[] = "EC Command";
+
+static size_t PrepareDrawTextTail(const char *text, size_t len, char *out, int *ec_match, bool *has_noise)
 {
-    int beg = -1;
-    int row = -1;
-    for (auto event = buff_.begin(); event != buff_.end(); event++)
+    size_t count = 0;
+    for (size_t i = 0; i < len; i++)
     {
-        std::string e_name_s = event->description_;
-        std::vector<std::string> e_args_l = event->params_;
+        char ch = text[i];
+        if (ch == '\n' || ch == '\0')
+            continue;
+        out[count++] = (char)kCharReplaceTable.chars[(unsigned char)ch];
+        *ec_match = (ch == kEcMark[*ec_match]) ? *ec_match + 1 : (ch == kEcMark[0] ? 1 : 0);
+        if (kEcMark[*ec_match] == '\0')
+        {
+            *has_noise = true;
+            *ec_match = 0;
+        }
+    }
+    return count;
+}
 
-        if (e_name_s == "display_attributes")
+#if defined(__AVX2__)
+#define DRAW_BLOCK 32
+#define DRAW_VEC __m256i
+#define DRAW_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define DRAW_STORE(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+#define DRAW_SET1(c) _mm256_set1_epi8(c)
+#define DRAW_CMPEQ(a, b) _mm256_cmpeq_epi8(a, b)
+#define DRAW_CMPGT(a, b) _mm256_cmpgt_epi8(a, b)
+#define DRAW_OR(a, b) _mm256_or_si256(a, b)
+#define DRAW_MASK(v) (unsigned int)_mm256_movemask_epi8(v)
+#define DRAW_BLEND(a, b, m) _mm256_blendv_epi8(a, b, m)
+#elif defined(__SSE2__) || defined(_M_X64)
+#define DRAW_BLOCK 16
+#define DRAW_VEC __m128i
+#define DRAW_LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define DRAW_STORE(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define DRAW_SET1(c) _mm_set1_epi8(c)
+#define DRAW_CMPEQ(a, b) _mm_cmpeq_epi8(a, b)
+#define DRAW_CMPGT(a, b) _mm_cmpgt_epi8(a, b)
+#define DRAW_OR(a, b) _mm_or_si128(a, b)
+#define DRAW_MASK(v) (unsigned int)_mm_movemask_epi8(v)
+#define DRAW_BLEND(a, b, m) _mm_or_si128(_mm_andnot_si128(m, a), _mm_and_si128(m, b))
+#endif
+
+size_t PrepareDrawText(const char *text, size_t len, char *out, bool *has_noise)
+{
+    /*
+        Function Name       : PrepareDrawText()
+        Parameters          : text, len: the draw text
+                              out: room for at least len chars
+                              has_noise: set if "EC Command" is in the text
+        Functionality       : in one pass replace the box drawing chars, drop
+                              '\n' and NUL and look for the EC log mark.
+                              A block of plain chars or box drawing chars is
+                              done by SSE2/AVX2, other blocks by the table.
+        Return Value        : the number of chars written to out
+    */
+    size_t count = 0;
+    size_t i = 0;
+    int ec_match = 0;
+    *has_noise = false;
+#ifdef DRAW_BLOCK
+    const DRAW_VEC control = DRAW_SET1(0x20);
+    const DRAW_VEC ec_first = DRAW_SET1(kEcMark[0]);
+    const DRAW_VEC newline = DRAW_SET1('\n');
+    const DRAW_VEC nul = DRAW_SET1('\0');
+    for (; i + DRAW_BLOCK <= len; i += DRAW_BLOCK)
+    {
+        DRAW_VEC v = DRAW_LOAD(text + i);
+        // the signed compare takes the bytes from 0x80 as negative, so both
+        // control chars and box drawing chars are below 0x20
+        unsigned int special = DRAW_MASK(DRAW_CMPGT(control, v));
+        unsigned int ec = DRAW_MASK(DRAW_CMPEQ(v, ec_first));
+        if (ec_match == 0 && ec == 0)
         {
-            if (e_args_l.size() != 1)
+            if (special == 0)
             {
-                cout << "select_graphic_rendition param num not 1" << endl;
+                DRAW_STORE(out + count, v);
+                count += DRAW_BLOCK;
                 continue;
             }
-            int cur = atoi(e_args_l[0].c_str());
-            if (cur == 0)
-            {
-                cur_fg_ = FG_DEFAULT;
-                cur_bg_ = BG_DEFAULT;
-                cur_text_attribute_ = TEXT_DEFAULT;
-            }
-            else if (FG.count(cur))
+            if (DRAW_MASK(DRAW_OR(DRAW_CMPEQ(v, newline), DRAW_CMPEQ(v, nul))) == 0)
             {
-                cur_fg_ = cur;
-            }
-            else if (BG.count(cur))
-            {
-                cur_bg_ = cur;
-            }
-            else if (TEXT.count(cur))
-            {
-                cur_text_attribute_ = cur;
-            }
-            else
-            {
-                cout << "display attribute not found: " << cur << endl;
+                for (size_t k = 0; k < sizeof(kCharReplace) / sizeof(kCharReplace[0]); k++)
+                    v = DRAW_BLEND(v, DRAW_SET1(kCharReplace[k][1]), DRAW_CMPEQ(v, DRAW_SET1(kCharReplace[k][0])));
+                DRAW_STORE(out + count, v);
+                count += DRAW_BLOCK;
+                continue;
             }
         }
+        count += PrepareDrawTextTail(text + i, DRAW_BLOCK, out + count, &ec_match, has_noise);
+    }
+#endif
+    count += PrepareDrawTextTail(text + i, len - i, out + count, &ec_match, has_noise);
+    return count;
+}
+
+void Vt100ScreenParser::Feed(const std::string &input)
+{
+    FeedBytes((const uint8_t *)input.data(), input.size());
+}
+
+void Vt100ScreenParser::FeedBytes(ByteSpan bytes)
+{
+    FeedBytes(bytes.data_, bytes.size_);
+}
+
+void Vt100ScreenParser::FeedBytes(const uint8_t *data, size_t len)
+{
+    /*
+       Function Name       : FeedBytes()
+       Parameters          : data, len: the serial data, NUL is not taken as the end
+       Functionality       : parse the serial data in place, the box drawing chars
+                             are replaced when they are drawn.
+       Function Invoked    : DebugScreen.SerialOutputSplit(), ParseScreen()
+       Return Value        : None
+   */
+    const char *input = (const char *)data;
+    TakeBackHeld();
+    debug_screen_.SerialOutputSplit(input, len, buff_);
+    if (!buff_.empty())
+    {
+        ParseScreen(input);
+    }
+    DrawHeld();
+}
+
+void Vt100ScreenParser::DrawHeld()
+{
+    /*
+        draw the bytes the noise filter keeps at the end of the input as
+        text, so the queries do not see a screen cut before them. The rows
+        and the cursor are kept, TakeBackHeld() restores them before the
+        next input, which draws the bytes again unless they start a log.
+    */
+    const string &held = debug_screen_.SplitHeld(buff_);
+    if (buff_.empty())
+        return;
+    held_drawn_ = true;
+    held_cursor_[0] = cur_row_;
+    held_cursor_[1] = cur_col_;
+    held_cursor_[2] = cur_fg_;
+    held_cursor_[3] = cur_bg_;
+    held_cursor_[4] = cur_text_attribute_;
+    held_rows_.clear();
+    held_chars_.clear();
+    held_attrs_.clear();
+    ParseScreen(held.data());
+}
 
-        else if (e_name_s == "cursor_position_start")
+void Vt100ScreenParser::TakeBackHeld()
+{
+    // restore the rows and the cursor of DrawHeld()
+    if (!held_drawn_)
+        return;
+    held_drawn_ = false;
+    for (size_t i = 0; i < held_rows_.size(); i++)
+    {
+        int row = held_rows_[i];
+        char *chars = &screen_chars_[row * width_];
+        CellAttr *attrs = &screen_attrs_[row * width_];
+        const char *old_chars = &held_chars_[i * width_];
+        const CellAttr *old_attrs = &held_attrs_[i * width_];
+        if (memcmp(chars, old_chars, width_) == 0 && memcmp(attrs, old_attrs, width_ * sizeof(CellAttr)) == 0)
+            continue;
+        memcpy(chars, old_chars, width_);
+        memcpy(attrs, old_attrs, width_ * sizeof(CellAttr));
+        for (int beg = 0, end = 0; beg < width_; beg = end)
         {
-            if (e_args_l.size() != 2)
-            {
-                cout << "cursor_position_start param num not 2" << endl;
-                continue;
-            }
-            row = String2Num(e_args_l[0], height_) - 1; // convert start from 1 to 0
-            beg = String2Num(e_args_l[1], width_) - 1;
+            while (end < width_ && attrs[end] == attrs[beg])
+                end++;
+            UpdateRowMasks(row, beg, end, attrs[beg]);
         }
+        row_stale_[row] = true;
+        row_dirty_[row] = true;
+        generation_++;
+        row_generation_[row] = generation_;
+        screen_info_stale_ = true;
+    }
+    cur_row_ = held_cursor_[0];
+    cur_col_ = held_cursor_[1];
+    cur_fg_ = held_cursor_[2];
+    cur_bg_ = held_cursor_[3];
+    cur_text_attribute_ = held_cursor_[4];
+}
+
+void Vt100ScreenParser::ReleaseHeld()
+{
+    // draw the bytes the noise filter keeps for good, no input follows them
+    if (!held_drawn_)
+        return;
+    TakeBackHeld();
+    debug_screen_.SerialOutputSplit("", 0, buff_, true, false, true);
+    if (!buff_.empty())
+        ParseScreen("");
+}
 
-        else if (e_name_s == "draw")
+void Vt100ScreenParser::ParseScreen(const char *input)
+{
+    // the cursor is kept between Feed() calls, the state machine engine
+    // continues a draw cut at the end of the last input
+    int beg = cur_col_;
+    int row = cur_row_;
+    for (auto event = buff_.begin(); event != buff_.end(); event++)
+    {
+        switch (event->op_)
         {
-            if (e_args_l.size() != 1)
+        case VT100_CMD_DISPLAY_ATTRIBUTES:
+        {
+            int cur = event->params_[0];
+            if (cur == 0)
             {
-                cout << "draw param number error" << endl;
-                continue;
+                cur_fg_ = FG_DEFAULT;
+                cur_bg_ = BG_DEFAULT;
+                cur_text_attribute_ = TEXT_DEFAULT;
             }
-            if (beg == -1 || row == -1)
+            else if (FgName(cur) != NULL)
             {
-                continue;
+                cur_fg_ = cur;
             }
-            std::string content = "";
-            int len = e_args_l[0].length();
-            for (int i = 0; i < len; i++)
+            else if (BgName(cur) != NULL)
             {
-                if (e_args_l[0][i] != '\n')
-                {
-                    content.push_back(e_args_l[0][i]);
-                }
+                cur_bg_ = cur;
             }
-
-            if (content.empty())
+            else if (TextName(cur) != NULL)
             {
-                continue;
+                cur_text_attribute_ = cur;
             }
-            if (content.find("EC Command") != -1)
+            else
             {
-                content = strsplit(content, "EC Command")[0];
+                cout << "display attribute not found: " << cur << endl;
             }
-            ScreenItem item(content, beg, beg + content.length(), cur_fg_, cur_bg_, cur_text_attribute_);
-            InsertScreenInfo(row, item);
-            beg += content.length();
+            break;
         }
 
-        else
-        {
-            cout << "function " << e_name_s << " not support" << endl;
-            continue;
+        case VT100_CMD_CURSOR_POSITION:
+            row = ParamToNum(event->params_[0], event->flags_ & VT100_FLAG_ROW_FROM_END, height_) - 1; // convert start from 1 to 0
+            beg = ParamToNum(event->params_[1], event->flags_ & VT100_FLAG_COL_FROM_END, width_) - 1;
+            break;
+
+        case VT100_CMD_DRAW:
+            if (beg == -1 || row == -1)
+            {
+                break;
+            }
+            if (held_drawn_ && row >= 0 && row < height_ &&
+                find(held_rows_.begin(), held_rows_.end(), row) == held_rows_.end())
+            {
+                held_rows_.push_back(row);
+                held_chars_.insert(held_chars_.end(), &screen_chars_[row * width_], &screen_chars_[(row + 1) * width_]);
+                held_attrs_.insert(held_attrs_.end(), &screen_attrs_[row * width_], &screen_attrs_[(row + 1) * width_]);
+            }
+            beg += InsertScreenInfo(row, beg, debug_screen_.GetText(*event, input), event->length_);
+            break;
+
+        default:
+            cout << "function " << (int)event->op_ << " not support" << endl;
+            break;
         }
     }
     buff_.clear();
-    MergeScreenInfo();
+    cur_row_ = row;
+    cur_col_ = beg;
+    // screen_info_ is merged when a query needs it
+    screen_info_stale_ = true;
 }
 
-void Vt100ScreenParser::InsertScreenInfo(int row, ScreenItem new_item)
+int Vt100ScreenParser::InsertScreenInfo(int row, int beg, const char *text, size_t len)
 {
-    if (row >= height_)
+    /*
+        Draw text at row, beg in the current attributes, '\n' and NUL are
+        not drawn.
+        If "EC Command" is left in the text, only strsplit(text, "EC Command")[0]
+        is drawn.
+        Return the number of chars the cursor moves.
+    */
+    if (draw_buff_.size() < len)
+        draw_buff_.resize(len);
+    bool has_noise = false;
+    const char *content = draw_buff_.data();
+    int count = (int)PrepareDrawText(text, len, draw_buff_.data(), &has_noise);
+    if (count == 0)
+        return 0;
+
+    if (has_noise)
+    {
+        // strtok() takes every char of "EC Command" as a delimiter
+        int token_beg = 0;
+        while (token_beg < count && strchr(kEcMark, content[token_beg]) != NULL)
+            token_beg++;
+        if (token_beg == count)
+            return 0;
+        int token_end = token_beg;
+        while (token_end < count && strchr(kEcMark, content[token_end]) == NULL)
+            token_end++;
+        content += token_beg;
+        count = token_end - token_beg;
+    }
+
+    if (row >= height_ || row < 0)
     {
         cout << "row number : " << row + 1 << " > screen height : " << height_ << ", please check configuration" << endl;
-        return;
+        return count;
+    }
+    // a repaint mostly writes the same cells, the row is marked only if
+    // a cell is changed
+    int first = max(0, -beg);
+    int last = min(count, width_ - beg);
+    if (first >= last)
+        return count;
+    char *chars = &screen_chars_[row * width_ + beg + first];
+    CellAttr *attrs = &screen_attrs_[row * width_ + beg + first];
+    CellAttr attr = CELL_ATTR(cur_fg_, cur_bg_, cur_text_attribute_);
+    bool changed = memcmp(chars, content + first, last - first) != 0;
+    for (int i = 0; i < last - first; i++)
+    {
+        changed = changed || attrs[i] != attr;
+        attrs[i] = attr;
+    }
+    memcpy(chars, content + first, last - first);
+    if (changed)
+    {
+        row_stale_[row] = true;
+        row_dirty_[row] = true;
+        UpdateRowMasks(row, beg + first, beg + last, attr);
+        generation_++;
+        row_generation_[row] = generation_;
     }
-    for (size_t i = 0; i < new_item.content_.length() && (i + new_item.beg_ < width_); i++)
+    return count;
+}
+
+unsigned char Vt100ScreenParser::GetAttrRoles(CellAttr attr)
+{
+    // the roles of the display attributes, one bit for each CELL_ROLE_*
+    int fg = CELL_FG(attr);
+    int bg = CELL_BG(attr);
+    int text = CELL_TEXT(attr);
+    unsigned char roles = 0;
+    if (fg == highlight_fg_ && bg == highlight_bg_)
+        roles |= 1 << CELL_ROLE_HIGHLIGHT;
+    if (fg == disable_fg_ && bg == disable_bg_ && text == disable_text_)
+        roles |= 1 << CELL_ROLE_DISABLE;
+    if (fg == subtitle_fg_ && bg == subtitle_bg_)
+        roles |= 1 << CELL_ROLE_SUBTITLE;
+    if (fg == selectable_fg_ && bg == selectable_bg_)
+        roles |= 1 << CELL_ROLE_SELECTABLE;
+    if (fg == highlight_popup_fg_ && bg == highlight_popup_bg_)
+        roles |= 1 << CELL_ROLE_HIGHLIGHT_POPUP;
+    return roles;
+}
+
+void Vt100ScreenParser::UpdateRowMasks(int row, int beg, int end, CellAttr attr)
+{
+    /*
+        update the row masks of the cells [beg, end) of a row, which are
+        written with attr
+    */
+    RowMasks &masks = row_masks_[row];
+    const char *chars = &screen_chars_[row * width_];
+    unsigned char roles = GetAttrRoles(attr);
+    for (int i = 0; i < ROW_MASK_WORDS; i++)
     {
-        char_matrix_[row][i + new_item.beg_].content_ = (char)new_item.content_[i];
-        char_matrix_[row][i + new_item.beg_].fg_color_ = new_item.fg_color_;
-        char_matrix_[row][i + new_item.beg_].bg_color_ = new_item.bg_color_;
-        char_matrix_[row][i + new_item.beg_].text_atr_ = new_item.text_atr_;
+        uint64_t bits = RowMaskBits(i, beg, end);
+        if (bits == 0)
+            continue;
+        for (int role = 0; role < CELL_ROLE_COUNT; role++)
+        {
+            if (roles & (1 << role))
+                masks.role_[role][i] |= bits;
+            else
+                masks.role_[role][i] &= ~bits;
+        }
+        uint64_t non_blank = 0;
+        for (int j = max(beg, i * 64); j < min(end, i * 64 + 64); j++)
+        {
+            if (chars[j] != ' ')
+                non_blank |= (uint64_t)1 << (j - i * 64);
+        }
+        masks.non_blank_[i] = (masks.non_blank_[i] & ~bits) | non_blank;
     }
 }
 
@@ -734,43 +1434,255 @@ void Vt100ScreenParser::MergeScreenInfo()
 {
     /*
     *  """
-        merge the _char_matrix to _screen_info, for following process
+        merge the _char_matrix to _screen_info, for following process,
+        only the rows changed after the last merge are merged again
         """
     */
 
     for (int i = 0; i < height_; i++)
     {
+        if (!row_stale_[i] && !screen_info_[i].empty())
+            continue;
+        row_stale_[i] = false;
         screen_info_[i].clear();
-        ScreenItem item0(std::string(1, char_matrix_[i][0].content_),
-                         0,
-                         1,
-                         char_matrix_[i][0].fg_color_,
-                         char_matrix_[i][0].bg_color_,
-                         char_matrix_[i][0].text_atr_);
-
-        for (int j = 1; j < width_; j++)
+        const char *chars = &screen_chars_[i * width_];
+        const CellAttr *attrs = &screen_attrs_[i * width_];
+        int beg = 0;
+        for (int j = 1; j <= width_; j++)
+        {
+            if (j < width_ && attrs[j] == attrs[beg])
+                continue;
+            screen_info_[i].push_back(ScreenItem(beg, j, attrs[beg]));
+            beg = j;
+        }
+
+        row_content_[i].assign(chars, width_);
+        UpdateRowFrame(i);
+    }
+}
+
+void Vt100ScreenParser::FindBorders(const string &content, const LineMatcher &line, vector<FrameBorder> &borders)
+{
+    // every match of the border line, the next one is searched after the last one
+    borders.clear();
+    FrameBorder border;
+    for (int from = 0; line.Find(content, from, &border); from = border.end_)
+        borders.push_back(border);
+}
+
+void Vt100ScreenParser::UpdateRowFrame(int row)
+{
+    /*
+        find the box borders in a merged row, the rows which are not
+        changed keep their borders
+    */
+    RowFrame &frame = row_frames_[row];
+    const string &content = row_content_[row];
+    frame.tops_.clear();
+    frame.bottoms_.clear();
+    frame.header_top_ = false;
+    frame.header_bottom_ = false;
+    frame.footer_top_ = false;
+    frame.footer_bottom_ = false;
+    // every border has a '-', and the popup mid has two '|'
+    if (content.find('-') != string::npos)
+    {
+        FindBorders(content, popup_line_top_, frame.tops_);
+        FindBorders(content, popup_line_bottom_, frame.bottoms_);
+        frame.header_top_ = header_line_top_.Find(content, 0);
+        frame.header_bottom_ = header_line_bottom_.Find(content, 0);
+        frame.footer_top_ = footer_line_top_.Find(content, 0);
+        frame.footer_bottom_ = footer_line_bottom_.Find(content, 0);
+    }
+    frame.popup_mid_ = popup_line_mid_.Find(content, 0);
+}
+
+vector<ScreenBox> Vt100ScreenParser::GetPopups()
+{
+    /*
+       Function Name       : GetPopups()
+       Parameters          : None
+       Functionality       : get the boxes drawn in the workspace, a box is a
+                             top border and the first bottom border below it
+                             in the same columns. A box drawn in another box
+                             has depth_ 1, and so on.
+       Return Value        : the boxes, in the order of the top border
+   */
+    vector<ScreenBox> boxes;
+    get_whole_page_info(true, true);
+    if (!check_screen_available())
+        return boxes;
+    for (int top = workspace_beg_; top < workspace_end_; top++)
+    {
+        const vector<FrameBorder> &tops = row_frames_[top].tops_;
+        for (auto it = tops.begin(); it != tops.end(); it++)
         {
-            if (item0.fg_color_ == char_matrix_[i][j].fg_color_ &&
-                item0.bg_color_ == char_matrix_[i][j].bg_color_ &&
-                item0.text_atr_ == char_matrix_[i][j].text_atr_)
+            for (int bottom = top + 1; bottom < workspace_end_; bottom++)
             {
-                item0.content_.push_back(char_matrix_[i][j].content_);
-                item0.end_ = j + 1;
+                const vector<FrameBorder> &bottoms = row_frames_[bottom].bottoms_;
+                auto end = bottoms.begin();
+                while (end != bottoms.end() && (end->beg_ != it->beg_ || end->end_ != it->end_))
+                    end++;
+                if (end == bottoms.end())
+                    continue;
+                ScreenBox box = {top, bottom, it->beg_, it->end_, 0,
+                                 it->mark_ == scroll_up_char_, end->mark_ == scroll_down_char_};
+                boxes.push_back(box);
+                break;
             }
-            else
+        }
+    }
+    for (auto it = boxes.begin(); it != boxes.end(); it++)
+    {
+        for (auto outer = boxes.begin(); outer != boxes.end(); outer++)
+        {
+            if (outer->top_ < it->top_ && outer->bottom_ > it->bottom_ &&
+                outer->beg_ <= it->beg_ && outer->end_ >= it->end_)
+                it->depth_++;
+        }
+    }
+    return boxes;
+}
+
+int Vt100ScreenParser::FindText(const TextQuery &query, vector<TextHit> &hits)
+{
+    /*
+       Function Name       : FindText()
+       Parameters          : query: the text, the rows, the columns and the
+                             display attributes searched
+       Functionality       : find every position of the text in the cells, a
+                             hit is in one row. The rows are searched in place
+                             by Boyer-Moore-Horspool.
+       Return Value        : the number of the hits, -1 if the text is empty
+    */
+    hits.clear();
+    int len = query.pattern == NULL ? 0 : strlen(query.pattern);
+    if (len == 0)
+        return -1;
+    int row_beg = max(query.row_beg, 0);
+    int row_end = query.row_end < 0 ? height_ : min(query.row_end, height_);
+    int col_beg = max(query.col_beg, 0);
+    int col_end = query.col_end < 0 ? width_ : min(query.col_end, width_);
+    unsigned char pattern[256];
+    // a text longer than a row is not found
+    if (len > width_ || len > (int)sizeof(pattern))
+        return 0;
+
+    // the chars are folded before they are compared, and the window is
+    // shifted by the last char of the window
+    unsigned char fold[256];
+    for (int i = 0; i < 256; i++)
+        fold[i] = query.ignore_case ? toupper(i) : i;
+    const unsigned char *text = (const unsigned char *)query.pattern;
+    int shift[256];
+    for (int i = 0; i < 256; i++)
+        shift[i] = len;
+    for (int i = 0; i < len; i++)
+    {
+        pattern[i] = fold[text[i]];
+        if (i < len - 1)
+            shift[pattern[i]] = len - 1 - i;
+    }
+
+    for (int row = row_beg; row < row_end; row++)
+    {
+        const unsigned char *chars = (const unsigned char *)&screen_chars_[row * width_];
+        const CellAttr *attrs = &screen_attrs_[row * width_];
+        for (int col = col_beg; col + len <= col_end;)
+        {
+            unsigned char last = fold[chars[col + len - 1]];
+            if (last == pattern[len - 1])
             {
-                screen_info_[i].push_back(item0);
-                ScreenItem new_item0(std::string(1, char_matrix_[i][j].content_),
-                                     j,
-                                     j + 1,
-                                     char_matrix_[i][j].fg_color_,
-                                     char_matrix_[i][j].bg_color_,
-                                     char_matrix_[i][j].text_atr_);
-                item0 = new_item0;
+                int i = 0;
+                while (i < len - 1 && fold[chars[col + i]] == pattern[i])
+                    i++;
+                bool same_attr = i == len - 1;
+                for (int j = col; j < col + len && same_attr; j++)
+                {
+                    same_attr = (query.fg == -1 || CELL_FG(attrs[j]) == query.fg) &&
+                                (query.bg == -1 || CELL_BG(attrs[j]) == query.bg) &&
+                                (query.text == -1 || CELL_TEXT(attrs[j]) == query.text);
+                }
+                if (same_attr)
+                {
+                    TextHit hit = {row, col, attrs[col]};
+                    hits.push_back(hit);
+                }
             }
+            // the shift of the last char never skips a hit, the hits may overlap
+            col += shift[last];
         }
-        screen_info_[i].push_back(item0);
     }
+    return hits.size();
+}
+
+vector<int> Vt100ScreenParser::GetDirtyRows()
+{
+    /*
+       Function Name       : GetDirtyRows()
+       Parameters          : None
+       Functionality       : get the rows which are different from the last
+                             ClearDirtyRows(), all rows after Init() and
+                             CleanScreenData(). A row written over and drawn
+                             back to the same cells is not dirty.
+       Return Value        : the row numbers, start from 0
+   */
+    vector<int> rows;
+    for (int i = 0; i < height_; i++)
+    {
+        if (!row_dirty_[i])
+            continue;
+        int beg = i * width_;
+        bool same = dirty_base_chars_.size() == screen_chars_.size() &&
+                    memcmp(&screen_chars_[beg], &dirty_base_chars_[beg], width_) == 0 &&
+                    memcmp(&screen_attrs_[beg], &dirty_base_attrs_[beg], width_ * sizeof(CellAttr)) == 0;
+        if (same)
+            row_dirty_[i] = false;
+        else
+            rows.push_back(i);
+    }
+    return rows;
+}
+
+void Vt100ScreenParser::ClearDirtyRows()
+{
+    if (dirty_base_chars_.size() != screen_chars_.size())
+    {
+        dirty_base_chars_ = screen_chars_;
+        dirty_base_attrs_ = screen_attrs_;
+    }
+    for (int i = 0; i < height_; i++)
+    {
+        if (!row_dirty_[i])
+            continue;
+        int beg = i * width_;
+        memcpy(&dirty_base_chars_[beg], &screen_chars_[beg], width_);
+        memcpy(&dirty_base_attrs_[beg], &screen_attrs_[beg], width_ * sizeof(CellAttr));
+    }
+    row_dirty_.assign(height_, false);
+}
+
+void Vt100ScreenParser::UpdateScreenInfo()
+{
+    // merge the cells changed by Feed() since the last query
+    if (!screen_info_stale_)
+        return;
+    MergeScreenInfo();
+    screen_info_stale_ = false;
+}
+
+static void CopyName(char *dst, const char *name, size_t size)
+{
+    size_t len = min(strlen(name), size - 1);
+    memcpy(dst, name, len);
+    dst[len] = '\0';
+}
+
+static void CopyText(char *dst, TextView text, size_t size)
+{
+    size_t len = min((size_t)text.len_, size - 1);
+    memcpy(dst, text.data_, len);
+    dst[len] = '\0';
 }
 
 ScreenStruct *Vt100ScreenParser::GetScreenColored()
@@ -779,23 +1691,58 @@ ScreenStruct *Vt100ScreenParser::GetScreenColored()
     {
         for (int j = 0; j < width_; j++)
         {
-            if (!FG.count(char_matrix_[i][j].fg_color_) ||
-                !BG.count(char_matrix_[i][j].bg_color_) ||
-                !TEXT.count(char_matrix_[i][j].text_atr_))
+            CellAttr attr = screen_attrs_[i * width_ + j];
+            const char *fg = FgName(CELL_FG(attr));
+            const char *bg = BgName(CELL_BG(attr));
+            const char *text = TextName(CELL_TEXT(attr));
+            if (fg == NULL || bg == NULL || text == NULL)
             {
                 return NULL;
             }
 
-            screen.data[i][j][0][0] = char_matrix_[i][j].content_;
+            screen_.data[i][j][0][0] = screen_chars_[i * width_ + j];
 
-            Strcpy(screen.data[i][j][1], FG[char_matrix_[i][j].fg_color_], sizeof(screen.data[i][j][1]) / sizeof(char));
-            Strcpy(screen.data[i][j][2], BG[char_matrix_[i][j].bg_color_], sizeof(screen.data[i][j][2]) / sizeof(char));
-            Strcpy(screen.data[i][j][3], TEXT[char_matrix_[i][j].text_atr_], sizeof(screen.data[i][j][3]) / sizeof(char));
+            CopyName(screen_.data[i][j][1], fg, sizeof(screen_.data[i][j][1]) / sizeof(char));
+            CopyName(screen_.data[i][j][2], bg, sizeof(screen_.data[i][j][2]) / sizeof(char));
+            CopyName(screen_.data[i][j][3], text, sizeof(screen_.data[i][j][3]) / sizeof(char));
         }
     }
-    screen.width = width_;
-    screen.heigh = height_;
-    return &screen;
+    screen_.width = width_;
+    screen_.heigh = height_;
+    return &screen_;
+}
+
+int Vt100ScreenParser::GetScreenPacked(int row_beg, int row_end, uint8_t *buf, int size)
+{
+    /*
+       Function Name       : GetScreenPacked()
+       Parameters          : row_beg, row_end: the rows [row_beg, row_end),
+                             row_end -1 for all the rows after row_beg
+                             buf: SCREEN_CELL_BYTES bytes are written for
+                             each cell of the rows, as many cells as fit
+       Functionality       : copy the cells with their display attributes
+                             codes, the char, fg, bg and text of a cell in
+                             one byte each, without the names of
+                             GetScreenColored()
+       Return Value        : the number of the bytes of the rows
+    */
+    row_beg = max(row_beg, 0);
+    row_end = row_end < 0 ? height_ : min(row_end, height_);
+    if (row_beg >= row_end)
+        return 0;
+    int cells = (row_end - row_beg) * width_;
+    int count = min(cells, max(size, 0) / SCREEN_CELL_BYTES);
+    const char *chars = &screen_chars_[row_beg * width_];
+    const CellAttr *attrs = &screen_attrs_[row_beg * width_];
+    for (int i = 0; i < count; i++)
+    {
+        uint8_t *cell = buf + i * SCREEN_CELL_BYTES;
+        cell[0] = chars[i];
+        cell[1] = CELL_FG(attrs[i]);
+        cell[2] = CELL_BG(attrs[i]);
+        cell[3] = CELL_TEXT(attrs[i]);
+    }
+    return cells * SCREEN_CELL_BYTES;
 }
 
 void SelectPage::Print()
@@ -816,210 +1763,491 @@ void SelectPage::Print()
 
 SelectPage *Vt100ScreenParser::GetSelectablePage()
 {
-    Page page = get_whole_page_info(true, true);
+    const Page &page = get_whole_page_info(true, true);
     // cout << "completed get wholepage" << endl;
-    select_page.highlight_idx = page.highlight_idx;
-    select_page.is_dialog_box = page.is_dialog_box;
-    select_page.is_popup = page.is_popup;
-    select_page.is_scrollable_down = page.is_scrollable_down;
-    select_page.is_scrollable_up = page.is_scrollable_up;
-    Strcpy(select_page.description, page.description, sizeof(select_page.description) / sizeof(char));
-    Strcpy(select_page.titles, page.titles, sizeof(select_page.titles) / sizeof(char));
-    select_page.entries_count = min(page.entries.size(), sizeof(select_page.entries) / sizeof(select_page.entries[0]));
-
-    for (int i = 0; i < select_page.entries_count; i++)
+    select_page_.highlight_idx = page.highlight_idx;
+    select_page_.is_dialog_box = page.is_dialog_box;
+    select_page_.is_popup = page.is_popup;
+    select_page_.is_scrollable_down = page.is_scrollable_down;
+    select_page_.is_scrollable_up = page.is_scrollable_up;
+    CopyText(select_page_.description, page.description, sizeof(select_page_.description) / sizeof(char));
+    CopyText(select_page_.titles, page.titles, sizeof(select_page_.titles) / sizeof(char));
+    select_page_.entries_count = min(page.entries.size(), sizeof(select_page_.entries) / sizeof(select_page_.entries[0]));
+
+    for (int i = 0; i < select_page_.entries_count; i++)
     {
-        Strcpy(select_page.entries[i][0], page.entries[i].key, sizeof(select_page.entries[i][0]) / sizeof(char));
-        Strcpy(select_page.entries[i][1], page.entries[i].value, sizeof(select_page.entries[i][1]) / sizeof(char));
-        Strcpy(select_page.entries[i][2], std::to_string(page.entries[i].type), sizeof(select_page.entries[i][2]) / sizeof(char));
+        CopyText(select_page_.entries[i][0], page.text.View(page.entries[i].key), sizeof(select_page_.entries[i][0]) / sizeof(char));
+        CopyText(select_page_.entries[i][1], page.text.View(page.entries[i].value), sizeof(select_page_.entries[i][1]) / sizeof(char));
+        snprintf(select_page_.entries[i][2], sizeof(select_page_.entries[i][2]) / sizeof(char), "%d", page.entries[i].type);
     }
     // cout << "return getselect page" <<endl;
-    // select_page.Print();
-    return &select_page;
+    // select_page_.Print();
+    return &select_page_;
 }
 
-Vt100ScreenParser::Page Vt100ScreenParser::get_whole_page_info(bool selectable_only, bool kv_sep)
+static PackedText PackText(char *buf, int &offset, TextView text)
 {
-    Page page_ret;
-    InitPageDict(page_ret);
-    if (!check_screen_available())
+    // copy the text and a '\0' to buf at offset
+    PackedText packed = {offset, text.len_};
+    memcpy(buf + offset, text.data_, text.len_);
+    buf[offset + text.len_] = '\0';
+    offset += text.len_ + 1;
+    return packed;
+}
+
+int Vt100ScreenParser::GetSelectPagePacked(char *buf, int size)
+{
+    /*
+       Function Name       : GetSelectPagePacked()
+       Parameters          : buf: the page is written if it fits in size bytes
+       Functionality       : pack the page of GetSelectablePage() without its
+                             limits, the texts are not cut and only the chars
+                             of the texts are copied
+       Return Value        : the bytes of the packed page
+    */
+    const Page &page = get_whole_page_info(true, true);
+    int count = page.entries.size();
+    int needed = sizeof(PackedPage) + count * sizeof(PackedEntry) + page.titles.size() + page.description.size() + 2;
+    for (int i = 0; i < count; i++)
+        needed += page.entries[i].key.len_ + page.entries[i].value.len_ + 2;
+    if (buf == NULL || size < needed)
+        return needed;
+
+    PackedPage header;
+    header.size = needed;
+    header.entries_count = count;
+    header.highlight_idx = page.highlight_idx;
+    header.flags = (page.is_scrollable_up ? PACKED_PAGE_SCROLLABLE_UP : 0) |
+                   (page.is_scrollable_down ? PACKED_PAGE_SCROLLABLE_DOWN : 0) |
+                   (page.is_dialog_box ? PACKED_PAGE_DIALOG_BOX : 0) |
+                   (page.is_popup ? PACKED_PAGE_POPUP : 0);
+    int offset = sizeof(PackedPage) + count * sizeof(PackedEntry);
+    header.titles = PackText(buf, offset, page.titles);
+    header.description = PackText(buf, offset, page.description);
+    memcpy(buf, &header, sizeof(header));
+    for (int i = 0; i < count; i++)
     {
-        cout << "no screen data, return empty dict" << endl;
-        return page_ret;
+        PackedEntry entry;
+        entry.key = PackText(buf, offset, page.text.View(page.entries[i].key));
+        entry.value = PackText(buf, offset, page.text.View(page.entries[i].value));
+        entry.type = page.entries[i].type;
+        memcpy(buf + sizeof(PackedPage) + i * sizeof(PackedEntry), &entry, sizeof(entry));
     }
-    InitHeader(page_ret);
-    InitFooter();
-    InitWorkspace();
-    if (!popup_parse(page_ret))
+    return needed;
+}
+
+// writes a record in JSON or MessagePack to a string, the bytes of the texts
+// are written as the chars U+0000 - U+00FF so the record is valid UTF-8
+class RecordWriter
+{
+private:
+    int format_;
+    std::string &out_;
+    vector<bool> first_; // no value is written in each open map or array
+    bool after_key_;
+
+    void Separate()
     {
-        non_popup_parse(page_ret, selectable_only, kv_sep);
+        // the ',' before a key or a value in JSON
+        if (after_key_)
+            after_key_ = false;
+        else if (!first_.empty() && !first_.back())
+            out_ += ',';
+        if (!first_.empty())
+            first_.back() = false;
     }
 
-    return page_ret;
-}
+    void Head(uint8_t fix, int fix_max, uint8_t code16, uint8_t code32, int count)
+    {
+        // the type and the count of a MessagePack map or array
+        if (count < fix_max)
+            out_ += (char)(fix | count);
+        else if (count <= 0xffff)
+            Big(code16, count, 2);
+        else
+            Big(code32, count, 4);
+    }
 
-void Vt100ScreenParser::InitPageDict(Vt100ScreenParser::Page &page)
-{
-    page.entries.clear();
-    page.titles = "";
-    page.description = "";
-    page.highlight_idx = -1;
-    page.is_scrollable_up = false;
-    page.is_scrollable_down = false;
-    page.is_dialog_box = false;
-    page.is_popup = false;
-}
+    void Big(uint8_t code, uint32_t n, int bytes)
+    {
+        out_ += (char)code;
+        for (int i = bytes - 1; i >= 0; i--)
+            out_ += (char)(n >> (i * 8));
+    }
 
-bool Vt100ScreenParser::check_screen_available()
-{
-    for (auto it = screen_info_.begin(); it != screen_info_.end(); it++)
+public:
+    RecordWriter(int format, std::string &out) : format_(format), out_(out), after_key_(false)
     {
-        if (it->empty())
-            return false;
+        out_.clear();
     }
-    return true;
-}
 
-std::string strip(std::string str)
-{
-    str.erase(0, str.find_first_not_of(" "));
-    str.erase(str.find_last_not_of(" ") + 1);
-    return str;
-}
+    void BeginMap(int count)
+    {
+        if (format_ == PAGE_RECORD_MSGPACK)
+            return Head(0x80, 16, 0xde, 0xdf, count);
+        Separate();
+        out_ += '{';
+        first_.push_back(true);
+    }
 
-std::string rstrip(std::string str)
-{
-    str.erase(str.find_last_not_of(" ") + 1);
-    return str;
-}
+    void BeginArray(int count)
+    {
+        if (format_ == PAGE_RECORD_MSGPACK)
+            return Head(0x90, 16, 0xdc, 0xdd, count);
+        Separate();
+        out_ += '[';
+        first_.push_back(true);
+    }
 
-std::string toupper(std::string str)
-{
-    int len = str.length();
-    for (int i = 0; i < len; i++)
+    void End(char close)
     {
-        str[i] = toupper(str[i]);
+        // '}' or ']'
+        if (format_ == PAGE_RECORD_MSGPACK)
+            return;
+        out_ += close;
+        first_.pop_back();
     }
-    return str;
-}
 
-void Vt100ScreenParser::GetCompleteKvThruRows(string *key, string *value, string *desc, int *idx, bool is_disable)
-{
-    string content = GetRowContent(*idx);
-    *key = strip(content.substr(0, value_beg_));
-    *value = strip(content.substr(value_beg_, des_beg_ - value_beg_));
-    *desc = strip(content.substr(des_beg_, content.length() - des_beg_));
-    string existence = "";
-    int free_space_for_key = value_beg_ - rstrip(content.substr(0, value_beg_)).length() - 3;
-    free_space_for_key = free_space_for_key >= 0 ? free_space_for_key : 0;
-    int free_space_for_val = des_beg_ - value_beg_ - (*value).length() - 3;
-    free_space_for_val = free_space_for_val >= 0 ? free_space_for_val : 0;
-    (*idx) += 1;
+    void Key(const char *key)
+    {
+        Text(TextView(key, strlen(key)));
+        if (format_ == PAGE_RECORD_JSON)
+            out_ += ':';
+        after_key_ = true;
+    }
 
-    while ((*idx) < workspace_end_ - 1)
+    void Text(TextView text)
     {
-        content = GetRowContent(*idx);
-        string _key = strip(content.substr(0, value_beg_));
-        string _value = strip(content.substr(value_beg_, des_beg_ - value_beg_));
-        string _desc = strip(content.substr(des_beg_, content.length() - des_beg_));
-        // menu is not supposed to take 2 row, for now
-        if (_key.length() >= 2 && _key.substr(0, 2) == "> ")
-            break;
-        // is_disable is false, break at disable text or subtitle
-        else if (!is_disable &&
-                 (CheckExistDisable(*idx, 0, des_beg_) ||
-                  CheckExistSubtitle(*idx, 0, value_beg_)))
-            break;
-        // is_disable is true, break at selectable text
-        else if (is_disable && !CheckExistDisable(*idx, 0, des_beg_))
-            break;
-        // no _keyand no _value
-        else if (_key.empty() && value->empty())
-            break;
-        // has _key
-        else if (!_key.empty())
+        if (format_ == PAGE_RECORD_MSGPACK)
+        {
+            int len = text.len_;
+            for (int i = 0; i < text.len_; i++)
+                len += (uint8_t)text.data_[i] >> 7;
+            if (len < 32)
+                out_ += (char)(0xa0 | len);
+            else if (len <= 0xff)
+                Big(0xd9, len, 1);
+            else if (len <= 0xffff)
+                Big(0xda, len, 2);
+            else
+                Big(0xdb, len, 4);
+        }
+        else
+        {
+            Separate();
+            out_ += '"';
+        }
+        // the runs of the chars written as they are are appended at once
+        int run = 0;
+        for (int i = 0; i < text.len_; i++)
         {
-            if (existence != "" && existence.find("key") == -1)
+            uint8_t ch = text.data_[i];
+            bool escape = format_ == PAGE_RECORD_JSON && (ch < 0x20 || ch == '"' || ch == '\\');
+            if (ch < 0x80 && !escape)
+                continue;
+            out_.append(text.data_ + run, i - run);
+            run = i + 1;
+            if (ch >= 0x80)
             {
-                cout << "independent value(" << _value << ") following independent key" << endl;
-                break;
+                out_ += (char)(0xc0 | (ch >> 6));
+                out_ += (char)(0x80 | (ch & 0x3f));
+            }
+            else
+            {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), ch < 0x20 ? "\\u%04x" : "\\%c", ch);
+                out_ += escaped;
             }
-            string first = strip(_key).find(" ") == -1 ? strip(_key) : strip(_key).substr(0, strip(_key).find(" "));
-            if (first.length() > free_space_for_key)
+        }
+        out_.append(text.data_ + run, text.len_ - run);
+        if (format_ == PAGE_RECORD_JSON)
+            out_ += '"';
+    }
+
+    void Int(int n)
+    {
+        if (format_ == PAGE_RECORD_MSGPACK)
+        {
+            if (n >= -32 && n < 128)
+                out_ += (char)n;
+            else
+                Big(0xd2, n, 4);
+            return;
+        }
+        Separate();
+        char digits[16];
+        snprintf(digits, sizeof(digits), "%d", n);
+        out_ += digits;
+    }
+
+    void Bool(bool b)
+    {
+        if (format_ == PAGE_RECORD_MSGPACK)
+        {
+            out_ += (char)(b ? 0xc3 : 0xc2);
+            return;
+        }
+        Separate();
+        out_ += b ? "true" : "false";
+    }
+};
+
+const std::string *Vt100ScreenParser::GetPageRecord(int format, int flags)
+{
+    /*
+       Function Name       : GetPageRecord()
+       Parameters          : format: PAGE_RECORD_JSON or PAGE_RECORD_MSGPACK
+                             flags: PAGE_RECORD_ROWS for the rows of the screen
+       Functionality       : write the page of GetSelectablePage() in one map:
+                             titles, description, highlight_idx, the flags of
+                             the page, entries [key, value, type] and rows.
+                             The record is written again only if the screen
+                             is changed
+       Return Value        : the record, NULL if the format is invalid
+    */
+    if (format != PAGE_RECORD_JSON && format != PAGE_RECORD_MSGPACK)
+        return NULL;
+    const Page &page = get_whole_page_info(true, true);
+    if (record_generation_ == generation_ && record_format_ == format && record_flags_ == flags)
+        return &page_record_;
+    record_generation_ = generation_;
+    record_format_ = format;
+    record_flags_ = flags;
+
+    bool with_rows = (flags & PAGE_RECORD_ROWS) != 0;
+    RecordWriter writer(format, page_record_);
+    writer.BeginMap(with_rows ? 9 : 8);
+    writer.Key("titles");
+    writer.Text(page.titles);
+    writer.Key("description");
+    writer.Text(page.description);
+    writer.Key("highlight_idx");
+    writer.Int(page.highlight_idx);
+    writer.Key("is_scrollable_up");
+    writer.Bool(page.is_scrollable_up);
+    writer.Key("is_scrollable_down");
+    writer.Bool(page.is_scrollable_down);
+    writer.Key("is_dialog_box");
+    writer.Bool(page.is_dialog_box);
+    writer.Key("is_popup");
+    writer.Bool(page.is_popup);
+    writer.Key("entries");
+    writer.BeginArray(page.entries.size());
+    for (auto it = page.entries.begin(); it != page.entries.end(); it++)
+    {
+        writer.BeginArray(3);
+        writer.Text(page.text.View(it->key));
+        writer.Text(page.text.View(it->value));
+        writer.Int(it->type);
+        writer.End(']');
+    }
+    writer.End(']');
+    if (with_rows)
+    {
+        writer.Key("rows");
+        writer.BeginArray(height_);
+        for (int i = 0; i < height_; i++)
+            writer.Text(TextView(&screen_chars_[i * width_], width_));
+        writer.End(']');
+    }
+    writer.End('}');
+    return &page_record_;
+}
+
+const Vt100ScreenParser::Page &Vt100ScreenParser::get_whole_page_info(bool selectable_only, bool kv_sep)
+{
+    /*
+        analyse the screen, the page is cached until a cell is changed,
+        so the queries between two Feed() analyse the screen once. If only
+        the rows of the entries are changed, the cached page is patched.
+    */
+    PageCache &cache = page_cache_[selectable_only][kv_sep];
+    Page &page_ret = cache.page;
+    if (cache.generation == generation_)
+        return page_ret;
+    UpdateScreenInfo();
+    bool patched = PatchPage(cache, selectable_only, kv_sep);
+    cache.generation = generation_;
+    if (patched)
+        return page_ret;
+    cache.entry_beg = -1;
+    InitPageDict(page_ret);
+    // no screen data, return empty dict
+    if (!check_screen_available())
+        return page_ret;
+    InitHeader(page_ret);
+    InitFooter();
+    InitWorkspace();
+    if (!popup_parse(page_ret))
+    {
+        non_popup_parse(page_ret, cache.steps, selectable_only, kv_sep);
+        cache.entry_beg = workspace_beg_ + 1;
+        cache.entry_end = workspace_end_ - 1;
+    }
+
+    return page_ret;
+}
+
+void Vt100ScreenParser::InitPageDict(Vt100ScreenParser::Page &page)
+{
+    page.entries.clear();
+    page.text.Reset();
+    page.titles.clear();
+    page.description.clear();
+    page.highlight_idx = -1;
+    page.is_scrollable_up = false;
+    page.is_scrollable_down = false;
+    page.is_dialog_box = false;
+    page.is_popup = false;
+}
+
+bool Vt100ScreenParser::check_screen_available()
+{
+    for (auto it = screen_info_.begin(); it != screen_info_.end(); it++)
+    {
+        if (it->empty())
+            return false;
+    }
+    return true;
+}
+
+static void UpperCase(TextView text, std::string &upper)
+{
+    upper.assign(text.data_, text.len_);
+    for (size_t i = 0; i < upper.size(); i++)
+        upper[i] = toupper((unsigned char)upper[i]);
+}
+
+// the parts in the rows joined by GetCompleteKvThruRows()
+#define JOINED_KEY 0x01
+#define JOINED_VALUE 0x02
+
+void Vt100ScreenParser::GetCompleteKvThruRows(TextView *key, TextView *value, TextView *desc, int *idx, bool is_disable)
+{
+    // the rows are joined in key_join_, value_join_ and desc_join_
+    TextView content = GetRowContent(*idx);
+    TextView first_key = content.Sub(0, value_beg_).Strip();
+    TextView first_value = content.Sub(value_beg_, des_beg_ - value_beg_).Strip();
+    TextView first_desc = content.Sub(des_beg_).Strip();
+    key_join_.assign(first_key.data_, first_key.len_);
+    value_join_.assign(first_value.data_, first_value.len_);
+    desc_join_.assign(first_desc.data_, first_desc.len_);
+    int existence = 0;
+    int free_space_for_key = value_beg_ - content.Sub(0, value_beg_).RStrip().len_ - 3;
+    free_space_for_key = free_space_for_key >= 0 ? free_space_for_key : 0;
+    int free_space_for_val = des_beg_ - value_beg_ - (int)value_join_.length() - 3;
+    free_space_for_val = free_space_for_val >= 0 ? free_space_for_val : 0;
+    (*idx) += 1;
+
+    while ((*idx) < workspace_end_ - 1)
+    {
+        TextView next_content = GetRowContent(*idx);
+        TextView _key = next_content.Sub(0, value_beg_).Strip();
+        TextView _value = next_content.Sub(value_beg_, des_beg_ - value_beg_).Strip();
+        TextView _desc = next_content.Sub(des_beg_).Strip();
+        // menu is not supposed to take 2 row, for now
+        if (_key.StartsWith("> "))
+            break;
+        // is_disable is false, break at disable text or subtitle
+        else if (!is_disable &&
+                 (CheckExistDisable(*idx, 0, des_beg_) ||
+                  CheckExistSubtitle(*idx, 0, value_beg_)))
+            break;
+        // is_disable is true, break at selectable text
+        else if (is_disable && !CheckExistDisable(*idx, 0, des_beg_))
+            break;
+        // no _keyand no _value
+        else if (_key.Empty() && value_join_.empty())
+            break;
+        // has _key
+        else if (!_key.Empty())
+        {
+            // independent value following independent key
+            if (existence == JOINED_VALUE)
+                break;
+            int space = _key.Find(' ');
+            TextView first = space == -1 ? _key : _key.Sub(0, space);
+            if (first.len_ > free_space_for_key)
             {
-                free_space_for_key = value_beg_ - rstrip(content.substr(0, value_beg_)).length() - 3;
+                free_space_for_key = value_beg_ - next_content.Sub(0, value_beg_).RStrip().len_ - 3;
                 free_space_for_key = free_space_for_key >= 0 ? free_space_for_key : 0;
             }
             else
                 break;
 
             // has _value
-            if (!_value.empty())
+            if (!_value.Empty())
             {
-                if (existence == "key")
+                if (existence == JOINED_KEY)
                     break;
-                string first = strip(_value).find(" ") == -1 ? strip(_value) : strip(_value).substr(0, strip(_value).find(" "));
-                if ((((*value)[0] == '[') && ((*value).find(']') == -1)) || (((*value)[0] == '<') && ((*value).find('>') == -1)) || first.length() > free_space_for_val)
+                int space = _value.Find(' ');
+                TextView first = space == -1 ? _value : _value.Sub(0, space);
+                if ((value_join_[0] == '[' && value_join_.find(']') == string::npos) || (value_join_[0] == '<' && value_join_.find('>') == string::npos) || first.len_ > free_space_for_val)
                 {
-                    free_space_for_val = des_beg_ - value_beg_ - _value.length() - 3;
+                    free_space_for_val = des_beg_ - value_beg_ - _value.len_ - 3;
                     free_space_for_val = free_space_for_val >= 0 ? free_space_for_val : 0;
                 }
                 else
                     break;
 
-                existence = "key_value";
-                (*value) += " " + _value;
+                existence = JOINED_KEY | JOINED_VALUE;
+                value_join_ += ' ';
+                value_join_.append(_value.data_, _value.len_);
             }
             // no _value
             else
             {
-                existence = "key";
+                existence = JOINED_KEY;
             }
-            (*key) += " " + _key;
+            key_join_ += ' ';
+            key_join_.append(_key.data_, _key.len_);
         }
         else
         {
             // no _key, but has _value
-            if (existence.empty() || (existence.find("value") != -1))
-                existence = "value";
+            if (existence == 0 || (existence & JOINED_VALUE))
+                existence = JOINED_VALUE;
             // independent key following independent value
             else
                 break;
-            (*value) += " " + _value;
+            value_join_ += ' ';
+            value_join_.append(_value.data_, _value.len_);
         }
 
         // concatenate description
-        if (!strip(_desc).empty())
+        if (!_desc.Empty())
         {
-            (*desc) += " " + _desc;
+            desc_join_ += ' ';
+            desc_join_.append(_desc.data_, _desc.len_);
         }
         (*idx) += 1;
     }
     (*idx) -= 1;
+    *key = key_join_;
+    *value = value_join_;
+    *desc = desc_join_;
 }
 
-void Vt100ScreenParser::GetCompleteHighlightKeyThruRows(string *key, string *desc, int *idx)
+void Vt100ScreenParser::GetCompleteHighlightKeyThruRows(TextView *key, TextView *desc, int *idx)
 {
-    string content = GetRowContent(*idx);
-    *key = content.substr(0, des_beg_);
-    string cur_key = *key;
-    *desc = content.substr(des_beg_, content.length() - des_beg_);
+    // the rows are joined in key_join_, the description is the first row's
+    TextView content = GetRowContent(*idx);
+    TextView cur_key = content.Sub(0, des_beg_);
+    key_join_.assign(cur_key.data_, cur_key.len_);
+    *desc = content.Sub(des_beg_);
     (*idx) += 1;
     // skip the scroll down char
     while ((*idx) < workspace_end_ - 1)
     {
         if (CheckExistHighlight(*idx, 0, des_beg_, false))
         {
-            string next_content = GetRowContent(*idx);
-            string next_key = next_content.substr(0, des_beg_);
-            if (rstrip(cur_key).length() == des_beg_)
-            {
-                *key = strip(*key) + strip(next_key);
-            }
-            else
-            {
-                *key = strip(*key) + " " + strip(next_key);
-            }
+            TextView next_key = TextView(GetRowContent(*idx)).Sub(0, des_beg_);
+            TextView next_strip = next_key.Strip();
+            key_join_.erase(0, key_join_.find_first_not_of(' '));
+            key_join_.erase(key_join_.find_last_not_of(' ') + 1);
+            if (cur_key.RStrip().len_ != des_beg_)
+                key_join_ += ' ';
+            key_join_.append(next_strip.data_, next_strip.len_);
             cur_key = next_key;
             (*idx) += 1;
         }
@@ -1029,27 +2257,390 @@ void Vt100ScreenParser::GetCompleteHighlightKeyThruRows(string *key, string *des
         }
     }
     (*idx) -= 1;
+    *key = key_join_;
 }
 
-char *Vt100ScreenParser::GetValueByKey(std::string key)
+const Vt100ScreenParser::KeyIndex &Vt100ScreenParser::GetKeyIndex(bool selectable_only, bool kv_sep)
+{
+    // the index of the page, it is built again only if the page is changed
+    PageCache &cache = page_cache_[selectable_only][kv_sep];
+    const Page &page = get_whole_page_info(selectable_only, kv_sep);
+    KeyIndex &index = cache.index;
+    if (index.generation == cache.generation)
+        return index;
+    index.generation = cache.generation;
+    index.has_trigrams = false;
+    index.text.Reset();
+    index.keys.clear();
+    for (auto it = page.entries.begin(); it != page.entries.end(); it++)
+    {
+        UpperCase(page.text.View(it->key).Strip(), key_query_);
+        index.keys.push_back(index.text.Append(key_query_));
+    }
+    return index;
+}
+
+void Vt100ScreenParser::AppendValuesByKey(const Page &page, const KeyIndex &index, TextView key, std::string &values)
 {
-    std::string values = "";
-    Page page = get_whole_page_info(false, true);
+    // append "value;" of each entry whose key contains the key, case-insensitive
     if (page.is_popup)
+        return;
+    UpperCase(key, key_query_);
+    for (size_t i = 0; i < page.entries.size(); i++)
     {
-        Strcpy(temp_value, values, 1000);
-        return temp_value;
+        if (index.text.View(index.keys[i]).Find(key_query_) == -1)
+            continue;
+        TextView value = page.text.View(page.entries[i].value).Strip();
+        values.append(value.data_, value.len_);
+        values += ';';
     }
+}
 
-    for (auto it = page.entries.begin(); it != page.entries.end(); it++)
+static void KeyTrigrams(TextView key, vector<int> &trigrams)
+{
+    // the trigrams of the letters and the digits of an upper-cased key, sorted
+    // and unique. The spaces and the marks are skipped as a key may be wrapped
+    // or cut at them, the key is padded so a short key has trigrams too
+    trigrams.clear();
+    int prev = 1;
+    int last = 1;
+    for (int i = 0; i < key.len_; i++)
+    {
+        unsigned char ch = key.data_[i];
+        if (!isalnum(ch))
+            continue;
+        trigrams.push_back((prev << 16) | (last << 8) | ch);
+        prev = last;
+        last = ch;
+    }
+    if (trigrams.empty())
+        return;
+    trigrams.push_back((prev << 16) | (last << 8) | 2);
+    sort(trigrams.begin(), trigrams.end());
+    trigrams.erase(unique(trigrams.begin(), trigrams.end()), trigrams.end());
+}
+
+void Vt100ScreenParser::IndexKeyTrigrams(KeyIndex &index)
+{
+    // the entries of each trigram of the keys
+    index.has_trigrams = true;
+    index.trigrams.clear();
+    index.trigram_counts.clear();
+    for (size_t i = 0; i < index.keys.size(); i++)
+    {
+        KeyTrigrams(index.text.View(index.keys[i]), key_trigrams_);
+        for (size_t j = 0; j < key_trigrams_.size(); j++)
+            index.trigrams.push_back(((uint64_t)key_trigrams_[j] << 32) | i);
+        index.trigram_counts.push_back(key_trigrams_.size());
+    }
+    sort(index.trigrams.begin(), index.trigrams.end());
+}
+
+static bool CompareKeyCandidate(const KeyCandidate &a, const KeyCandidate &b)
+{
+    return a.score_ != b.score_ ? a.score_ > b.score_ : a.entry_ < b.entry_;
+}
+
+int Vt100ScreenParser::FindKeys(TextView key, int min_score, vector<KeyCandidate> &candidates)
+{
+    /*
+       Function Name       : FindKeys()
+       Parameters          : key: the key looked up, case-insensitive
+                             min_score: the lowest score of the candidates
+                             candidates: the entries whose key is like the key
+       Functionality       : match the key against the keys of the page of
+                             GetValueByKey() by their trigrams, so a key which
+                             is wrapped across rows or cut is still found. The
+                             score is the Dice coefficient of the trigrams
+       Return Value        : the number of the candidates, the best first
+    */
+    candidates.clear();
+    GetKeyIndex(false, true);
+    const Page &page = page_cache_[false][true].page;
+    KeyIndex &index = page_cache_[false][true].index;
+    if (page.is_popup)
+        return 0;
+    if (!index.has_trigrams)
+        IndexKeyTrigrams(index);
+
+    UpperCase(key, key_query_);
+    KeyTrigrams(key_query_, key_trigrams_);
+    key_shared_.assign(index.keys.size(), 0);
+    for (size_t i = 0; i < key_trigrams_.size(); i++)
+    {
+        uint64_t trigram = (uint64_t)key_trigrams_[i] << 32;
+        vector<uint64_t>::const_iterator it = lower_bound(index.trigrams.begin(), index.trigrams.end(), trigram);
+        for (; it != index.trigrams.end() && (*it >> 32) == (uint64_t)key_trigrams_[i]; it++)
+            key_shared_[*it & 0xffffffff]++;
+    }
+    for (size_t i = 0; i < key_shared_.size(); i++)
+    {
+        if (key_shared_[i] == 0)
+            continue;
+        KeyCandidate candidate;
+        candidate.entry_ = i;
+        candidate.score_ = 200 * key_shared_[i] / (int)(key_trigrams_.size() + index.trigram_counts[i]);
+        if (candidate.score_ >= min_score)
+            candidates.push_back(candidate);
+    }
+    sort(candidates.begin(), candidates.end(), CompareKeyCandidate);
+    return candidates.size();
+}
+
+char *Vt100ScreenParser::GetValueByKey(std::string key)
+{
+    /*
+       Function Name       : GetValueByKey()
+       Parameters          : key: a part of the key, case-insensitive
+       Functionality       : get the values of the entries whose key contains
+                             the key, joined by ';'
+       Return Value        : the values, valid until the next key lookup
+    */
+    const KeyIndex &index = GetKeyIndex(false, true);
+    const Page &page = page_cache_[false][true].page;
+    key_values_.clear();
+    AppendValuesByKey(page, index, key, key_values_);
+    return &key_values_[0];
+}
+
+int Vt100ScreenParser::GetValuesByKeys(const char *const *keys, int count, const char **values)
+{
+    /*
+       Function Name       : GetValuesByKeys()
+       Parameters          : keys: count keys, values: count values are written
+       Functionality       : GetValueByKey() of each key, the page is analysed
+                             and indexed once for all the keys
+       Return Value        : count, the values are valid until the next key lookup
+    */
+    const KeyIndex &index = GetKeyIndex(false, true);
+    const Page &page = page_cache_[false][true].page;
+    key_values_.clear();
+    key_values_beg_.clear();
+    for (int i = 0; i < count; i++)
+    {
+        key_values_beg_.push_back(key_values_.size());
+        AppendValuesByKey(page, index, TextView(keys[i], strlen(keys[i])), key_values_);
+        key_values_ += '\0';
+    }
+    for (int i = 0; i < count; i++)
+        values[i] = key_values_.data() + key_values_beg_[i];
+    return count;
+}
+
+static int FindText(TextView text, TextView pattern, bool ignore_case)
+{
+    // the first position of the pattern in the text, -1 if not found
+    for (int i = 0; i + pattern.len_ <= text.len_; i++)
+    {
+        int j = 0;
+        while (j < pattern.len_ && (text.data_[i + j] == pattern.data_[j] ||
+                                    (ignore_case && toupper((unsigned char)text.data_[i + j]) == toupper((unsigned char)pattern.data_[j]))))
+            j++;
+        if (j == pattern.len_)
+            return i;
+    }
+    return -1;
+}
+
+static bool MatchText(TextView text, int match, const char *pattern, bool ignore_case, const std::regex &pattern_regex)
+{
+    if (match == TEXT_MATCH_ANY)
+        return true;
+    if (match == TEXT_MATCH_REGEX)
+        return regex_search(text.data_, text.data_ + text.len_, pattern_regex);
+    TextView expected(pattern, strlen(pattern));
+    if (match == TEXT_MATCH_EQUAL)
+        return text.len_ == expected.len_ && FindText(text, expected, ignore_case) == 0;
+    if (match == TEXT_MATCH_PREFIX)
+        return FindText(text.Sub(0, expected.len_), expected, ignore_case) == 0;
+    return FindText(text, expected, ignore_case) != -1;
+}
+
+int Vt100ScreenParser::QueryEntries(const EntryQuery &query, vector<int> &entries)
+{
+    /*
+       Function Name       : QueryEntries()
+       Parameters          : query: the filters, entries: the indexes of the
+                             entries matched by all the filters
+       Functionality       : filter the entries of the page in one pass, the
+                             indexes are read by GetPageEntry() until the
+                             screen is changed
+       Return Value        : the number of the entries, -1 if the query is invalid
+    */
+    entries.clear();
+    int matches[] = {query.key_match, query.value_match};
+    const char *patterns[] = {query.key, query.value};
+    std::regex regexes[2];
+    for (int i = 0; i < 2; i++)
+    {
+        if (matches[i] < TEXT_MATCH_ANY || matches[i] > TEXT_MATCH_REGEX || (matches[i] != TEXT_MATCH_ANY && patterns[i] == NULL))
+            return -1;
+        if (matches[i] != TEXT_MATCH_REGEX)
+            continue;
+        try
+        {
+            regexes[i].assign(patterns[i], query.ignore_case ? std::regex::ECMAScript | std::regex::icase : std::regex::ECMAScript);
+        }
+        catch (const std::regex_error &)
+        {
+            // an invalid regex is an invalid query, the caller gets -1
+            return -1;
+        }
+    }
+    if (query.pos_match < ENTRY_POS_ANY || query.pos_match > ENTRY_POS_HIGHLIGHT)
+        return -1;
+
+    const Page &page = get_whole_page_info(query.selectable_only != 0, true);
+    int pos_beg = query.pos_beg;
+    int pos_end = query.pos_end;
+    if (query.pos_match == ENTRY_POS_HIGHLIGHT)
+    {
+        if (page.highlight_idx == -1)
+            return 0;
+        pos_beg += page.highlight_idx;
+        pos_end += page.highlight_idx;
+    }
+    for (int i = 0; i < (int)page.entries.size(); i++)
+    {
+        const Entry &entry = page.entries[i];
+        if (query.pos_match != ENTRY_POS_ANY && (i < pos_beg || i > pos_end))
+            continue;
+        if (query.types != 0 && (entry.type < 0 || entry.type > 30 || !(query.types & (1 << entry.type))))
+            continue;
+        if (!MatchText(page.text.View(entry.key), query.key_match, query.key, query.ignore_case, regexes[0]) ||
+            !MatchText(page.text.View(entry.value), query.value_match, query.value, query.ignore_case, regexes[1]))
+            continue;
+        entries.push_back(i);
+    }
+    return entries.size();
+}
+
+int Vt100ScreenParser::GetPageEntry(bool selectable_only, int idx, TextView *key, TextView *value)
+{
+    // the entry idx of the page, return its type, -1 if there is no such entry
+    const Page &page = get_whole_page_info(selectable_only, true);
+    if (idx < 0 || idx >= (int)page.entries.size())
+        return -1;
+    *key = page.text.View(page.entries[idx].key);
+    *value = page.text.View(page.entries[idx].value);
+    return page.entries[idx].type;
+}
+
+int Vt100ScreenParser::PlanNavigation(const NavQuery &query, vector<NavStep> &steps)
+{
+    /*
+       Function Name       : PlanNavigation()
+       Parameters          : query: the target and how the keys move the highlight
+                             steps: the keys to press and the highlight
+                             expected after each key
+       Functionality       : find the fewest keys which move the highlight to
+                             the target, the keys can be sent at once and the
+                             screen checked only at the end. A key which
+                             scrolls the page is not planned, as the entries
+                             it shows are unknown
+       Return Value        : the number of the steps, -1 if the query is
+                             invalid, -2 if the target is not on the page or
+                             no entry is highlighted
+    */
+    steps.clear();
+    if (query.key_match < TEXT_MATCH_ANY || query.key_match > TEXT_MATCH_REGEX || (query.key_match != TEXT_MATCH_ANY && query.key == NULL))
+        return -1;
+    std::regex key_regex;
+    if (query.key_match == TEXT_MATCH_REGEX)
+    {
+        try
+        {
+            key_regex.assign(query.key, query.ignore_case ? std::regex::ECMAScript | std::regex::icase : std::regex::ECMAScript);
+        }
+        catch (const std::regex_error &)
+        {
+            // an invalid regex is an invalid query, the caller gets -1
+            return -1;
+        }
+    }
+
+    const Page &page = get_whole_page_info(false, true);
+    int count = page.entries.size();
+    if (page.highlight_idx < 0 || page.highlight_idx >= count)
+        return -2;
+    // the entries the highlight can be on
+    vector<int> focus;
+    vector<int> focus_pos(count, -1);
+    for (int i = 0; i < count; i++)
+    {
+        int type = page.entries[i].type;
+        if (type == EntryType_DISABLE_TXT || type == EntryType_SUBTITLE)
+            continue;
+        focus_pos[i] = focus.size();
+        focus.push_back(i);
+    }
+    if (focus_pos[page.highlight_idx] == -1)
+        return -2;
+
+    // the fewest keys from the highlight to each entry, breadth first
+    int focus_count = focus.size();
+    bool wrap = query.wrap && !page.is_scrollable_up && !page.is_scrollable_down;
+    vector<int> dist(focus_count, -1);
+    vector<int> prev(focus_count, -1);
+    vector<int> prev_key(focus_count, -1);
+    vector<int> queue(1, focus_pos[page.highlight_idx]);
+    dist[queue[0]] = 0;
+    for (size_t i = 0; i < queue.size(); i++)
+    {
+        int cur = queue[i];
+        int next[NAV_KEY_ENTER] = {-1, -1, -1, -1};
+        if (cur > 0 || wrap)
+            next[NAV_KEY_UP] = cur > 0 ? cur - 1 : focus_count - 1;
+        if (cur < focus_count - 1 || wrap)
+            next[NAV_KEY_DOWN] = cur < focus_count - 1 ? cur + 1 : 0;
+        if (query.page_jump && !page.is_scrollable_up)
+            next[NAV_KEY_PAGE_UP] = 0;
+        if (query.page_jump && !page.is_scrollable_down)
+            next[NAV_KEY_PAGE_DOWN] = focus_count - 1;
+        for (int key = 0; key < NAV_KEY_ENTER; key++)
+        {
+            if (next[key] == -1 || dist[next[key]] != -1)
+                continue;
+            dist[next[key]] = dist[cur] + 1;
+            prev[next[key]] = cur;
+            prev_key[next[key]] = key;
+            queue.push_back(next[key]);
+        }
+    }
+
+    // the target, or the nearest entry whose key is matched
+    int target = -1;
+    if (query.key_match == TEXT_MATCH_ANY)
+    {
+        if (query.target >= 0 && query.target < count)
+            target = focus_pos[query.target];
+    }
+    else
+    {
+        for (int i = 0; i < focus_count; i++)
+        {
+            TextView key = page.text.View(page.entries[focus[i]].key);
+            if (!MatchText(key, query.key_match, query.key, query.ignore_case != 0, key_regex))
+                continue;
+            if (target == -1 || dist[i] < dist[target])
+                target = i;
+        }
+    }
+    if (target == -1)
+        return -2;
+
+    for (int cur = target; cur != queue[0]; cur = prev[cur])
+    {
+        NavStep step = {prev_key[cur], focus[cur]};
+        steps.push_back(step);
+    }
+    reverse(steps.begin(), steps.end());
+    if (query.enter)
     {
-        std::string key2 = it->key;
-        std::string value = it->value;
-        if (toupper(strip(key2)).find(toupper(key)) != -1)
-            values += (strip(value) + ";");
+        NavStep step = {NAV_KEY_ENTER, -1};
+        steps.push_back(step);
     }
-    Strcpy(temp_value, values, 1000);
-    return temp_value;
+    return steps.size();
 }
 
 bool Vt100ScreenParser::popup_parse(Vt100ScreenParser::Page &page)
@@ -1058,24 +2649,18 @@ bool Vt100ScreenParser::popup_parse(Vt100ScreenParser::Page &page)
     int popup_end = 0;
     int col_beg = 0;
     int col_end = 0;
-    vector<Entry> entries;
+    vector<Entry> &entries = page.entries;
 
+    // the popup is the last top border in the workspace
     for (int it = workspace_beg_; it < workspace_end_; it++)
     {
-        std::string content = GetRowContent(it);
-        std::smatch result;
-        bool match = regex_search(content, result, *popup_regex_top_);
-        if (match)
+        const vector<FrameBorder> &tops = row_frames_[it].tops_;
+        if (!tops.empty())
         {
             popup_beg = it;
-            string::const_iterator beg_iter = result[0].first;
-            for (col_beg = 0; beg_iter != content.begin(); beg_iter--, col_beg++)
-                ;
-            string::const_iterator end_iter = result[0].second;
-            for (col_end = 0; end_iter != content.begin(); end_iter--, col_end++)
-                ;
-            std::string scroll = result[1];
-            page.is_scrollable_up = ((scroll[0] == scroll_up_char_) ? true : false);
+            col_beg = tops[0].beg_;
+            col_end = tops[0].end_;
+            page.is_scrollable_up = tops[0].mark_ == scroll_up_char_;
         }
     }
 
@@ -1084,37 +2669,23 @@ bool Vt100ScreenParser::popup_parse(Vt100ScreenParser::Page &page)
 
     for (int it = popup_beg + 1; it < workspace_end_; it++)
     {
-        std::string content = GetRowContent(it);
-        std::smatch result;
-        bool mid_match = regex_search(content, result, *popup_regex_mid_);
-        if (mid_match)
+        const RowFrame &frame = row_frames_[it];
+        if (frame.popup_mid_)
         {
-            std::string txt = content.substr(col_beg + 1, col_end - 2 - col_beg);
+            TextView txt = TextView(GetRowContent(it)).Sub(col_beg + 1, col_end - 2 - col_beg);
             if (CheckExistHighlightPopup(it, col_beg, col_end))
                 page.highlight_idx = entries.size();
+            Entry entry = {page.text.Append(txt), page.text.Append(TextView()), EntryType_SELECTABLE_TXT};
             if ((CheckExistRowFgBgText(it, -1, highlight_bg_, -1, col_beg, col_end, false)) || (CheckExistRowFgBgText(it, -1, default_bg_, -1, col_beg, col_end, false)))
-            {
-                entries.push_back({txt, "", EntryType_INPUT_BOX});
-            }
-            else
-            {
-                entries.push_back({txt, "", EntryType_SELECTABLE_TXT});
-            }
+                entry.type = EntryType_INPUT_BOX;
+            entries.push_back(entry);
         }
-        else
+        // popup menu mid break is ignored
+        else if (!frame.bottoms_.empty())
         {
-            bool end_match = regex_search(content, result, *popup_regex_bottom_);
-            if (end_match)
-            {
-                popup_end = it + 1;
-                std::string scroll = result[1];
-                page.is_scrollable_down = ((scroll[0] == scroll_down_char_) ? true : false);
-                break;
-            }
-            else
-            {
-                cout << "popup menu mid break, ignore" << endl;
-            }
+            popup_end = it + 1;
+            page.is_scrollable_down = frame.bottoms_[0].mark_ == scroll_down_char_;
+            break;
         }
     }
 
@@ -1130,34 +2701,49 @@ bool Vt100ScreenParser::popup_parse(Vt100ScreenParser::Page &page)
         }
     }
 
+    // popup begin, but end not found, ignore the entries
     if (popup_end == 0)
-        cout << "popup begin, but end not found, ignore" << endl;
-    else
-        page.entries = entries;
+        entries.clear();
 
     page.is_popup = true;
     return true;
 }
 
-void Vt100ScreenParser::non_popup_parse(Vt100ScreenParser::Page &page, bool selectable_only, bool kv_sep)
+void Vt100ScreenParser::non_popup_parse(Vt100ScreenParser::Page &page, vector<PageStep> &steps, bool selectable_only, bool kv_sep)
 {
     page.is_scrollable_up = IsScrollableUp();
     page.is_scrollable_down = IsScrollableDown();
-    vector<Entry> entries;
-    int entry_beg = workspace_beg_ + 1;
+    page.entries.clear();
+    page.description = "";
+    page.highlight_idx = -1;
+    steps.clear();
+    ParseEntries(page, steps, workspace_beg_ + 1, selectable_only, kv_sep);
+}
+
+void Vt100ScreenParser::ParseEntries(Vt100ScreenParser::Page &page, vector<PageStep> &steps, int idx, bool selectable_only, bool kv_sep, PagePatch *patch)
+{
+    /*
+        parse the entries from row idx to the end of the workspace, the
+        state at the first row of each step is kept in steps
+    */
+    vector<Entry> &entries = page.entries;
     int entry_end = workspace_end_ - 1;
-    int idx = entry_beg;
-    int highlight_idx = -1;
+    int &highlight_idx = page.highlight_idx;
     int highlight_first = 0;
-    std::string desc_full = "";
+    std::string &desc_full = page.description;
+    TextArena &text = page.text;
 
     while (idx < entry_end)
     {
+        if (patch != NULL && ResumePatch(page, steps, idx, patch))
+            return;
+        PageStep step = {idx, (int)entries.size(), highlight_idx, (int)desc_full.size(), text.Size(), false};
+        steps.push_back(step);
         int entry_type = EntryType_UNKNOWN;
-        std::string content = GetRowContent(idx);
-        std::string key = content.substr(0, value_beg_);
-        std::string value = content.substr(value_beg_, des_beg_ - value_beg_);
-        std::string desc = content.substr(des_beg_, content.size() - des_beg_);
+        TextView content = GetRowContent(idx);
+        TextView key = content.Sub(0, value_beg_);
+        TextView value = content.Sub(value_beg_, des_beg_ - value_beg_);
+        TextView desc = content.Sub(des_beg_);
         bool is_highlighted = false;
         if (CheckExistHighlight(idx, 0, des_beg_, false))
         {
@@ -1170,7 +2756,7 @@ void Vt100ScreenParser::non_popup_parse(Vt100ScreenParser::Page &page, bool sele
             else
                 highlight_first = false;
         }
-        std::string kv = key + value;
+        TextView kv = content.Sub(0, des_beg_); // key + value
 
         if (CheckExistDisable(idx, 0, des_beg_, true))
         {
@@ -1183,45 +2769,49 @@ void Vt100ScreenParser::non_popup_parse(Vt100ScreenParser::Page &page, bool sele
         {
             entry_type = EntryType_SUBTITLE;
         }
-        else if (strip(key).length() >= 2 && strip(key).substr(0, 2) == "> ")
+        else if (key.Strip().StartsWith("> "))
         {
             entry_type = EntryType_MENU;
             key = kv;
-            value = "";
-            if (highlight_idx == entries.size())
+            value = TextView();
+            if (highlight_idx == (int)entries.size())
             {
                 // key, desc, idx = self._get_complete_highlight_key_thru_rows(idx)
 
                 GetCompleteHighlightKeyThruRows(&key, &desc, &idx);
             }
         }
-        else if (strip(value).length() >= 1 && strip(value).substr(0, 1) == "<")
+        else if (value.Strip().StartsWith("<"))
         {
             // key, value, desc, idx = self._get_complete_kv_thru_rows(idx)
             bool is_disable = false;
             GetCompleteKvThruRows(&key, &value, &desc, &idx, is_disable);
 
-            kv = key + value;
+            kv_join_.assign(key.data_, key.len_);
+            kv_join_.append(value.data_, value.len_);
+            kv = kv_join_;
             entry_type = EntryType_DROP_DOWN;
         }
-        else if (strip(value).length() >= 1 && strip(value).substr(0, 1) == "[")
+        else if (value.Strip().StartsWith("["))
         {
             // key, value, desc, idx = self._get_complete_kv_thru_rows(idx)
             bool is_disable = false;
             GetCompleteKvThruRows(&key, &value, &desc, &idx, is_disable);
-            kv = key + value;
-            if (strip(value) == "[ ]")
+            kv_join_.assign(key.data_, key.len_);
+            kv_join_.append(value.data_, value.len_);
+            kv = kv_join_;
+            if (value.Strip() == TextView("[ ]", 3))
                 entry_type = EntryType_CHECKBOX_UNCHECKED;
-            else if (strip(value) == "[X]")
+            else if (value.Strip() == TextView("[X]", 3))
                 entry_type = EntryType_CHECKBOX_CHECKED;
             else
                 entry_type = EntryType_INPUT_BOX;
         }
-        else if (CheckExistRowFgBgText(idx, selectable_fg_, selectable_bg_, -1, 0, value_beg_, true) || !strip(kv).empty())
+        else if (CheckExistSelectable(idx, 0, value_beg_, true) || !kv.Strip().Empty())
         {
-            if (!strip(key).empty() && (!strip(value).empty()))
+            if (!key.Strip().Empty() && (!value.Strip().Empty()))
             {
-                if (key.substr(key.size() - 2, 2) == "  ")
+                if (key.EndsWith("  "))
                 {
                     // key, value, desc, idx = self._get_complete_kv_thru_rows(idx)
                     bool is_disable = false;
@@ -1230,8 +2820,8 @@ void Vt100ScreenParser::non_popup_parse(Vt100ScreenParser::Page &page, bool sele
                 else
                 {
                     key = kv;
-                    value = "";
-                    if (highlight_idx == entries.size())
+                    value = TextView();
+                    if (highlight_idx == (int)entries.size())
                     {
                         // key, desc, idx = self._get_complete_highlight_key_thru_rows(idx)
                         GetCompleteHighlightKeyThruRows(&key, &desc, &idx);
@@ -1249,54 +2839,194 @@ void Vt100ScreenParser::non_popup_parse(Vt100ScreenParser::Page &page, bool sele
                     if (is_highlighted)
                     {
                         if (highlight_first)
-                            entries.push_back({strip(key), strip(value), entry_type});
+                        {
+                            Entry entry = {text.Append(key.Strip()), text.Append(value.Strip()), entry_type};
+                            entries.push_back(entry);
+                        }
                         else
                         {
-                            Entry last_higlight_entry;
                             if (entries.size() > 0)
                             {
-                                last_higlight_entry = *(entries.end() - 1);
-                                *(entries.end() - 1) = {last_higlight_entry.key + strip(key), last_higlight_entry.value + strip(value), last_higlight_entry.type};
+                                Entry &last_higlight_entry = entries.back();
+                                last_higlight_entry.key = text.Join(last_higlight_entry.key, key.Strip());
+                                last_higlight_entry.value = text.Join(last_higlight_entry.value, value.Strip());
+                                steps.back().merged = true;
                             }
                         }
                     }
                     else
-                        entries.push_back({strip(key), strip(value), entry_type});
+                    {
+                        Entry entry = {text.Append(key.Strip()), text.Append(value.Strip()), entry_type};
+                        entries.push_back(entry);
+                    }
                 }
                 else
                 {
                     if (is_highlighted && !highlight_first)
                     {
-                        Entry last_higlight_entry;
                         if (entries.size() > 0)
                         {
-                            last_higlight_entry = *(entries.end() - 1);
-                            *(entries.end() - 1) = {last_higlight_entry.key + strip(kv), last_higlight_entry.value, last_higlight_entry.type};
+                            Entry &last_higlight_entry = entries.back();
+                            last_higlight_entry.key = text.Join(last_higlight_entry.key, kv.Strip());
+                            steps.back().merged = true;
                         }
                     }
                     else
-                        entries.push_back({strip(kv), "", entry_type});
+                    {
+                        Entry entry = {text.Append(kv.Strip()), text.Append(TextView()), entry_type};
+                        entries.push_back(entry);
+                    }
                 }
             }
         }
-        if (!strip(desc).empty())
-            desc_full += desc;
+        if (!desc.Strip().Empty())
+            desc_full.append(desc.data_, desc.len_);
         idx += 1;
     }
-
-    page.description = desc_full;
-    page.entries = entries;
-    page.highlight_idx = highlight_idx;
 }
 
-SelectPage::SelectPage()
+bool Vt100ScreenParser::ResumePatch(Vt100ScreenParser::Page &page, vector<PageStep> &steps, int idx, PagePatch *patch)
 {
-    Clear();
-}
+    /*
+        the steps from row idx are the same as the cached ones if the rows
+        are not changed and the state at idx is the same, then the entries
+        and the description of the cached page are appended instead
+    */
+    vector<PageStep> &cached = patch->steps;
+    if (idx <= patch->last_row)
+        return false;
+    while (patch->next_step < cached.size() && cached[patch->next_step].row < idx)
+        patch->next_step++;
+    if (patch->next_step == cached.size() || cached[patch->next_step].row != idx)
+        return false;
 
-void SelectPage::Clear()
-{
-    entries_count = 0;
+    // the last entry is the same and it is not appended by the cached steps
+    const PageStep &step = cached[patch->next_step];
+    int count = page.entries.size();
+    if (step.entries_count != count || count <= patch->entries_count)
+        return false;
+    const Entry &last = page.entries.back();
+    const Entry &cached_last = patch->entries[count - 1 - patch->entries_count];
+    if (page.text.View(last.key) != patch->text.View(cached_last.key) ||
+        page.text.View(last.value) != patch->text.View(cached_last.value) || last.type != cached_last.type)
+        return false;
+    for (size_t i = patch->next_step; i < cached.size() && cached[i].entries_count == count; i++)
+    {
+        if (cached[i].merged)
+            return false;
+    }
+    // the highlight entry is the same, or both are before the last entry
+    bool same_highlight = page.highlight_idx == step.highlight_idx;
+    if (!same_highlight && (page.highlight_idx == -1 || page.highlight_idx >= count ||
+                            step.highlight_idx == -1 || step.highlight_idx >= count))
+        return false;
+
+    // the text of the entries after the step is after its text_len
+    int desc_offset = (int)page.description.size() - step.desc_len;
+    int text_offset = page.text.Size() - step.text_len;
+    TextSpan text_tail = {step.text_len, patch->text.Size() - step.text_len};
+    page.text.Append(patch->text.View(text_tail));
+    for (size_t i = count - patch->entries_count; i < patch->entries.size(); i++)
+    {
+        Entry entry = patch->entries[i];
+        entry.key.beg_ += text_offset;
+        entry.value.beg_ += text_offset;
+        page.entries.push_back(entry);
+    }
+    page.description.append(patch->description, step.desc_len, string::npos);
+    if (same_highlight)
+        page.highlight_idx = patch->highlight_idx;
+    for (size_t i = patch->next_step; i < cached.size(); i++)
+    {
+        PageStep cached_step = cached[i];
+        cached_step.desc_len += desc_offset;
+        cached_step.text_len += text_offset;
+        if (!same_highlight)
+            cached_step.highlight_idx = page.highlight_idx;
+        steps.push_back(cached_step);
+    }
+    return true;
+}
+
+bool Vt100ScreenParser::PatchPage(PageCache &cache, bool selectable_only, bool kv_sep)
+{
+    /*
+        patch the cached page if the header, the footer and the popups are
+        not changed, such as the highlight is moved or a value is edited.
+        The entries are parsed again from the step before the first changed
+        row, until the steps are in the same state as the cached ones.
+    */
+    if (cache.entry_beg == -1 || cache.entry_beg != workspace_beg_ + 1 || cache.entry_end != workspace_end_ - 1)
+        return false;
+    int first_row = -1;
+    int last_row = -1;
+    for (int i = 0; i < height_; i++)
+    {
+        if (row_generation_[i] <= cache.generation)
+            continue;
+        if (i < header_rows_end_ || i >= footer_rows_beg_)
+            return false;
+        if (!row_frames_[i].tops_.empty())
+            return false;
+        if (i < cache.entry_beg || i >= cache.entry_end)
+            continue;
+        if (first_row == -1)
+            first_row = i;
+        last_row = i;
+    }
+    Page &page = cache.page;
+    vector<PageStep> &steps = cache.steps;
+    page.is_scrollable_up = IsScrollableUp();
+    page.is_scrollable_down = IsScrollableDown();
+    if (first_row == -1)
+        return true;
+    if (steps.empty())
+        return false;
+
+    // a step reads its rows and the first row of the next step
+    size_t restart = 0;
+    while (restart + 1 < steps.size() && steps[restart + 1].row < first_row)
+        restart++;
+    // the last entry before the step must not be appended by the steps after it
+    while (restart > 0)
+    {
+        size_t i = restart;
+        while (i < steps.size() && steps[i].entries_count == steps[restart].entries_count && !steps[i].merged)
+            i++;
+        if (i == steps.size() || steps[i].entries_count != steps[restart].entries_count)
+            break;
+        restart--;
+    }
+
+    PageStep step = steps[restart];
+    PagePatch &patch = page_patch_;
+    patch.last_row = last_row;
+    patch.entries_count = step.entries_count;
+    patch.highlight_idx = page.highlight_idx;
+    patch.entries.assign(page.entries.begin() + step.entries_count, page.entries.end());
+    patch.text.Swap(page.text);
+    patch.description.swap(page.description);
+    patch.steps.assign(steps.begin() + restart, steps.end());
+    patch.next_step = 0;
+
+    // the entries before the step are in the text before its text_len
+    page.entries.resize(step.entries_count);
+    page.text.Assign(patch.text, step.text_len);
+    page.description.assign(patch.description, 0, step.desc_len);
+    page.highlight_idx = step.highlight_idx;
+    steps.resize(restart);
+    ParseEntries(page, steps, step.row, selectable_only, kv_sep, &patch);
+    return true;
+}
+
+SelectPage::SelectPage()
+{
+    Clear();
+}
+
+void SelectPage::Clear()
+{
+    entries_count = 0;
     int len = sizeof(description) / sizeof(description[0]);
     for (int i = 0; i < len; i++)
         description[i] = '\0';
@@ -1324,46 +3054,6 @@ void SelectPage::Clear()
     is_popup = false;
 }
 
-DLLEXPORT void Init(char *platform)
-{
-    if (vt100_screen_parser != NULL)
-    {
-        delete vt100_screen_parser;
-        vt100_screen_parser = NULL;
-    }
-    vt100_screen_parser = new Vt100ScreenParser(platform);
-}
-
-DLLEXPORT void CleanScreenData()
-{
-    if (vt100_screen_parser == NULL)
-    {
-        cout << "Error: Need init" << endl;
-        return;
-    }
-    vt100_screen_parser->CleanScreenData();
-}
-
-DLLEXPORT void Feed(char *str1)
-{
-    if (vt100_screen_parser == NULL)
-    {
-        cout << "Error: Need init" << endl;
-        return;
-    }
-    vt100_screen_parser->Feed(str1);
-}
-
-DLLEXPORT char *GetValueByKey(char *str1)
-{
-    if (vt100_screen_parser == NULL)
-    {
-        cout << "Error: Need init" << endl;
-        return NULL;
-    }
-    return vt100_screen_parser->GetValueByKey(str1);
-}
-
 ScreenStruct::ScreenStruct()
 {
     heigh = 0;
@@ -1407,60 +3097,668 @@ WholePage::WholePage()
     Clear();
 }
 
-DLLEXPORT ScreenStruct GetScreenColored()
+// a parser and the results of the exports for it, the calls on a handle are
+// serialised by its lock and the handles are parsed in parallel
+struct Vt100Handle
 {
-    if (vt100_screen_parser == NULL)
+    Vt100ScreenParser parser;
+    WholePage whole_page;
+    vector<char> select_page; // packed
+    string edk_shell;
+    std::mutex lock;
+
+    Vt100Handle(const std::string &platform) : parser(platform) {}
+};
+
+DLLEXPORT Vt100Handle *Vt100Create(char *platform)
+{
+    // a parser of one console, it is freed by Vt100Destroy()
+    return new Vt100Handle(platform);
+}
+
+DLLEXPORT void Vt100Destroy(Vt100Handle *handle)
+{
+    // no call on the handle may be running
+    delete handle;
+}
+
+DLLEXPORT void Vt100CleanScreenData(Vt100Handle *handle)
+{
+    if (handle == NULL)
     {
         cout << "Error: Need init" << endl;
-        return ScreenStruct();
+        return;
     }
-    return *vt100_screen_parser->GetScreenColored();
+    lock_guard<mutex> guard(handle->lock);
+    handle->parser.CleanScreenData();
 }
 
-DLLEXPORT SelectPage GetSelectPage()
+DLLEXPORT void Vt100SetSplitEngine(Vt100Handle *handle, int engine)
 {
-    // cout << "at get select page" << endl;
-    if (vt100_screen_parser == NULL)
+    if (handle == NULL)
     {
-        cout << "Error: vt100_screen_parser need init" << endl;
-        select_page.Clear();
-        return select_page;
+        cout << "Error: Need init" << endl;
+        return;
     }
-    SelectPage *select_page_ptr = vt100_screen_parser->GetSelectablePage();
-    return *select_page_ptr;
+    lock_guard<mutex> guard(handle->lock);
+    handle->parser.SetSplitEngine(engine);
 }
 
-DLLEXPORT WholePage GetWholePage()
+DLLEXPORT bool Vt100LoadNoiseFilter(Vt100Handle *handle, char *file)
+{
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        return false;
+    }
+    lock_guard<mutex> guard(handle->lock);
+    if (!handle->parser.LoadNoiseFilter(file))
+    {
+        cout << "Error: can not read " << file << endl;
+        return false;
+    }
+    return true;
+}
+
+DLLEXPORT int Vt100GetNoiseFilterHits(Vt100Handle *handle, char *pattern)
+{
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        return -1;
+    }
+    lock_guard<mutex> guard(handle->lock);
+    return handle->parser.GetNoiseFilterHits(pattern);
+}
+
+DLLEXPORT void Vt100Feed(Vt100Handle *handle, char *str1)
+{
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        return;
+    }
+    lock_guard<mutex> guard(handle->lock);
+    handle->parser.FeedBytes((const uint8_t *)str1, strlen(str1));
+}
+
+DLLEXPORT void Vt100FeedBytes(Vt100Handle *handle, const uint8_t *data, size_t len)
+{
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        return;
+    }
+    lock_guard<mutex> guard(handle->lock);
+    handle->parser.FeedBytes(data, len);
+}
+
+DLLEXPORT int Vt100GetDirtyRows(Vt100Handle *handle, int *rows, int size)
+{
+    // write the dirty row numbers to rows, return how many rows are dirty
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        return 0;
+    }
+    lock_guard<mutex> guard(handle->lock);
+    vector<int> dirty_rows = handle->parser.GetDirtyRows();
+    for (int i = 0; i < (int)dirty_rows.size() && i < size; i++)
+        rows[i] = dirty_rows[i];
+    return dirty_rows.size();
+}
+
+DLLEXPORT void Vt100ClearDirtyRows(Vt100Handle *handle)
+{
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        return;
+    }
+    lock_guard<mutex> guard(handle->lock);
+    handle->parser.ClearDirtyRows();
+}
+
+DLLEXPORT char *Vt100GetValueByKey(Vt100Handle *handle, char *str1)
+{
+    // the values are valid until the next key lookup on the handle
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        return NULL;
+    }
+    lock_guard<mutex> guard(handle->lock);
+    return handle->parser.GetValueByKey(str1);
+}
+
+DLLEXPORT int Vt100GetValuesByKeys(Vt100Handle *handle, char **keys, int count, const char **values)
+{
+    /*
+        write the values of each of the count keys to values, as
+        GetValueByKey(), the page is analysed once for all the keys. The
+        values are valid until the next GetValueByKey() or GetValuesByKeys().
+    */
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        return 0;
+    }
+    lock_guard<mutex> guard(handle->lock);
+    return handle->parser.GetValuesByKeys(keys, count, values);
+}
+
+DLLEXPORT int Vt100FindKeys(Vt100Handle *handle, const char *key, int min_score, int *candidates, int size)
+{
+    /*
+        write KEY_CANDIDATE_INTS ints for each entry whose key is like the key
+        to candidates: the index of the entry for GetPageEntry() with
+        selectable_only 0, the score 0 - 100. Return how many candidates are
+        found, the best first, -1 if there is no key.
+    */
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        return -1;
+    }
+    if (key == NULL)
+        return -1;
+    lock_guard<mutex> guard(handle->lock);
+    vector<KeyCandidate> found;
+    int count = handle->parser.FindKeys(TextView(key, strlen(key)), min_score, found);
+    for (int i = 0; i < count && (i + 1) * KEY_CANDIDATE_INTS <= size; i++)
+    {
+        candidates[i * KEY_CANDIDATE_INTS] = found[i].entry_;
+        candidates[i * KEY_CANDIDATE_INTS + 1] = found[i].score_;
+    }
+    return count;
+}
+
+DLLEXPORT int Vt100QueryEntries(Vt100Handle *handle, const EntryQuery *query, int *entries, int size)
+{
+    /*
+        write the indexes of the entries matched by the query to entries,
+        return how many entries are matched, -1 if the query is invalid.
+        The entries are read by GetPageEntry() until the next Feed().
+    */
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        return -1;
+    }
+    lock_guard<mutex> guard(handle->lock);
+    vector<int> matched;
+    int count = handle->parser.QueryEntries(*query, matched);
+    for (int i = 0; i < count && i < size; i++)
+        entries[i] = matched[i];
+    return count;
+}
+
+DLLEXPORT int Vt100GetPageEntry(Vt100Handle *handle, int selectable_only, int idx, char *key, int key_size, char *value, int value_size)
+{
+    // copy the key and the value of the entry idx, return its type, -1 if there is no such entry
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        return -1;
+    }
+    lock_guard<mutex> guard(handle->lock);
+    TextView key_text;
+    TextView value_text;
+    int type = handle->parser.GetPageEntry(selectable_only != 0, idx, &key_text, &value_text);
+    if (type == -1)
+        return -1;
+    if (key != NULL && key_size > 0)
+        CopyText(key, key_text, key_size);
+    if (value != NULL && value_size > 0)
+        CopyText(value, value_text, value_size);
+    return type;
+}
+
+DLLEXPORT int Vt100PlanNavigation(Vt100Handle *handle, const NavQuery *query, int *steps, int size)
+{
+    /*
+        write NAV_STEP_INTS ints for each key which moves the highlight to the
+        target to steps: the key NAV_KEY_*, the highlight entry expected after
+        the key (-1 after enter). Return how many keys are planned, -1 if the
+        query is invalid, -2 if the target is not on the page.
+    */
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        return -1;
+    }
+    lock_guard<mutex> guard(handle->lock);
+    vector<NavStep> planned;
+    int count = handle->parser.PlanNavigation(*query, planned);
+    for (int i = 0; i < count && (i + 1) * NAV_STEP_INTS <= size; i++)
+    {
+        steps[i * NAV_STEP_INTS] = planned[i].key_;
+        steps[i * NAV_STEP_INTS + 1] = planned[i].highlight_idx_;
+    }
+    return count;
+}
+
+DLLEXPORT int Vt100FindText(Vt100Handle *handle, const TextQuery *query, int *hits, int size)
+{
+    /*
+        write TEXT_HIT_INTS ints for each position of the text in the cells to
+        hits: row, column, fg, bg, text attribute of the first cell. Return
+        how many hits are found, -1 if the text is empty.
+    */
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        return -1;
+    }
+    lock_guard<mutex> guard(handle->lock);
+    vector<TextHit> found;
+    int count = handle->parser.FindText(*query, found);
+    for (int i = 0; i < count && (i + 1) * TEXT_HIT_INTS <= size; i++)
+    {
+        int *hit = hits + i * TEXT_HIT_INTS;
+        hit[0] = found[i].row_;
+        hit[1] = found[i].col_;
+        hit[2] = CELL_FG(found[i].attr_);
+        hit[3] = CELL_BG(found[i].attr_);
+        hit[4] = CELL_TEXT(found[i].attr_);
+    }
+    return count;
+}
+
+DLLEXPORT int Vt100GetPopups(Vt100Handle *handle, int *boxes, int size)
+{
+    /*
+        write SCREEN_BOX_INTS ints for each box drawn in the workspace to
+        boxes: top row, bottom row, left column, right column + 1, depth,
+        scroll up, scroll down. Return how many boxes are drawn.
+    */
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        return 0;
+    }
+    lock_guard<mutex> guard(handle->lock);
+    vector<ScreenBox> popups = handle->parser.GetPopups();
+    for (int i = 0; i < (int)popups.size() && (i + 1) * SCREEN_BOX_INTS <= size; i++)
+    {
+        int *box = boxes + i * SCREEN_BOX_INTS;
+        box[0] = popups[i].top_;
+        box[1] = popups[i].bottom_;
+        box[2] = popups[i].beg_;
+        box[3] = popups[i].end_;
+        box[4] = popups[i].depth_;
+        box[5] = popups[i].scroll_up_;
+        box[6] = popups[i].scroll_down_;
+    }
+    return popups.size();
+}
+
+DLLEXPORT const ScreenStruct *Vt100GetScreenColored(Vt100Handle *handle)
+{
+    // the screen is kept in the handle until the next call of this function
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        return NULL;
+    }
+    lock_guard<mutex> guard(handle->lock);
+    return handle->parser.GetScreenColored();
+}
+
+DLLEXPORT void Vt100GetScreenSize(Vt100Handle *handle, int *height, int *width)
+{
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        *height = 0;
+        *width = 0;
+        return;
+    }
+    lock_guard<mutex> guard(handle->lock);
+    *height = handle->parser.GetHeight();
+    *width = handle->parser.GetWidth();
+}
+
+DLLEXPORT int Vt100GetScreenPacked(Vt100Handle *handle, uint8_t *buf, int size)
+{
+    /*
+        write SCREEN_CELL_BYTES bytes for each cell of the screen to buf, row
+        by row: char, fg, bg, text attribute. Return the bytes of the screen,
+        the cells which do not fit in size bytes are not written.
+    */
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        return 0;
+    }
+    lock_guard<mutex> guard(handle->lock);
+    return handle->parser.GetScreenPacked(0, -1, buf, size);
+}
+
+DLLEXPORT int Vt100GetScreenRowsPacked(Vt100Handle *handle, int row_beg, int row_end, uint8_t *buf, int size)
+{
+    // as Vt100GetScreenPacked() for the rows [row_beg, row_end), row_end -1 for the rows after row_beg
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        return 0;
+    }
+    lock_guard<mutex> guard(handle->lock);
+    return handle->parser.GetScreenPacked(row_beg, row_end, buf, size);
+}
+
+DLLEXPORT const SelectPage *Vt100GetSelectPage(Vt100Handle *handle)
 {
-    if (vt100_screen_parser == NULL)
+    // the page is kept in the handle until the next call of this function
+    if (handle == NULL)
     {
         cout << "Error: vt100_screen_parser need init" << endl;
-        whole_page.Clear();
-        return whole_page;
+        return NULL;
+    }
+    lock_guard<mutex> guard(handle->lock);
+    return handle->parser.GetSelectablePage();
+}
+
+DLLEXPORT int Vt100GetSelectPagePacked(Vt100Handle *handle, char *buf, int size)
+{
+    /*
+        write the page of GetSelectPage() to buf as a PackedPage, the entries
+        and the texts if it fits in size bytes. Return the bytes of the page,
+        buf may be NULL to get the size.
+    */
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        return 0;
+    }
+    lock_guard<mutex> guard(handle->lock);
+    return handle->parser.GetSelectPagePacked(buf, size);
+}
+
+DLLEXPORT const char *Vt100GetSelectPageBuffer(Vt100Handle *handle, int *size)
+{
+    // the packed page is kept in the handle until the next call of this function
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        *size = 0;
+        return NULL;
+    }
+    lock_guard<mutex> guard(handle->lock);
+    vector<char> &page = handle->select_page;
+    page.resize(handle->parser.GetSelectPagePacked(NULL, 0));
+    *size = handle->parser.GetSelectPagePacked(&page[0], page.size());
+    return &page[0];
+}
+
+DLLEXPORT int Vt100GetPageRecord(Vt100Handle *handle, int format, int flags, char *buf, int size)
+{
+    /*
+        write the page in one record of the format PAGE_RECORD_JSON or
+        PAGE_RECORD_MSGPACK to buf if it fits in size bytes. Return the bytes
+        of the record, buf may be NULL to get the size, -1 if the format is
+        invalid.
+    */
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        return -1;
+    }
+    lock_guard<mutex> guard(handle->lock);
+    const string *record = handle->parser.GetPageRecord(format, flags);
+    if (record == NULL)
+        return -1;
+    if (buf != NULL && size >= (int)record->size())
+        memcpy(buf, record->data(), record->size());
+    return record->size();
+}
+
+DLLEXPORT const char *Vt100GetPageRecordBuffer(Vt100Handle *handle, int format, int flags, int *size)
+{
+    // the record is kept in the handle until the next GetPageRecord(), NULL if the format is invalid
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        *size = 0;
+        return NULL;
     }
-    vector<string> whole = vt100_screen_parser->GetWholePage();
-    whole_page.heigh = vt100_screen_parser->GetHeight();
-    whole_page.width = vt100_screen_parser->GetWidth();
+    lock_guard<mutex> guard(handle->lock);
+    const string *record = handle->parser.GetPageRecord(format, flags);
+    *size = record != NULL ? record->size() : 0;
+    return record != NULL ? record->data() : NULL;
+}
+
+static const WholePage *FillWholePage(Vt100Handle *handle)
+{
+    // the lock of the handle is held by the caller
+    WholePage &whole_page = handle->whole_page;
+    vector<string> whole = handle->parser.GetWholePage();
+    whole_page.heigh = handle->parser.GetHeight();
+    whole_page.width = handle->parser.GetWidth();
     for (int i = 0; i < whole_page.heigh; i++)
     {
-        int w = whole_page.width < whole[i].size() ? whole_page.width : whole[i].size();
+        int w = whole_page.width < (int)whole[i].size() ? whole_page.width : (int)whole[i].size();
         // cout << whole[i] << endl;
         for (int j = 0; j < w; j++)
         {
             whole_page.data[i][j] = whole[i][j];
         }
     }
-    return whole_page;
+    return &whole_page;
+}
+
+DLLEXPORT const WholePage *Vt100GetWholePage(Vt100Handle *handle)
+{
+    // the page is kept in the handle until the next call of this function
+    if (handle == NULL)
+    {
+        cout << "Error: vt100_screen_parser need init" << endl;
+        return NULL;
+    }
+    lock_guard<mutex> guard(handle->lock);
+    return FillWholePage(handle);
+}
+
+DLLEXPORT char *Vt100ParseEdkShell(Vt100Handle *handle, char *input, bool remove_ec_logs)
+{
+    // the text is kept in the handle until the next call of this function
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        return NULL;
+    }
+    lock_guard<mutex> guard(handle->lock);
+    handle->parser.ParseEdkShell(input, remove_ec_logs, handle->edk_shell);
+    return &handle->edk_shell[0];
+}
+
+// the handle of the exports without a handle, created by the first Init()
+// and never freed, the calls of other threads may be using it
+std::atomic<Vt100Handle *> vt100_handle(NULL);
+std::mutex init_lock;
+string edk_shell_text; // of ParseEdkShell() before Init()
+std::mutex edk_shell_lock;
+
+DLLEXPORT void Init(char *platform)
+{
+    // Init() again makes a new parser in the handle under its lock
+    lock_guard<mutex> guard(init_lock);
+    Vt100Handle *handle = vt100_handle;
+    if (handle == NULL)
+    {
+        vt100_handle = Vt100Create(platform);
+        return;
+    }
+    std::unique_ptr<Vt100ScreenParser> parser(new Vt100ScreenParser(platform));
+    lock_guard<mutex> handle_guard(handle->lock);
+    handle->parser = std::move(*parser);
+    handle->whole_page.Clear();
+}
+
+DLLEXPORT void CleanScreenData()
+{
+    Vt100CleanScreenData(vt100_handle);
+}
+
+DLLEXPORT void SetSplitEngine(int engine)
+{
+    Vt100SetSplitEngine(vt100_handle, engine);
+}
+
+DLLEXPORT bool LoadNoiseFilter(char *file)
+{
+    return Vt100LoadNoiseFilter(vt100_handle, file);
+}
+
+DLLEXPORT int GetNoiseFilterHits(char *pattern)
+{
+    return Vt100GetNoiseFilterHits(vt100_handle, pattern);
+}
+
+DLLEXPORT void Feed(char *str1)
+{
+    Vt100Feed(vt100_handle, str1);
+}
+
+DLLEXPORT void FeedBytes(const uint8_t *data, size_t len)
+{
+    Vt100FeedBytes(vt100_handle, data, len);
+}
+
+DLLEXPORT int GetDirtyRows(int *rows, int size)
+{
+    return Vt100GetDirtyRows(vt100_handle, rows, size);
+}
+
+DLLEXPORT void ClearDirtyRows()
+{
+    Vt100ClearDirtyRows(vt100_handle);
+}
+
+DLLEXPORT char *GetValueByKey(char *str1)
+{
+    return Vt100GetValueByKey(vt100_handle, str1);
+}
+
+DLLEXPORT int GetValuesByKeys(char **keys, int count, const char **values)
+{
+    return Vt100GetValuesByKeys(vt100_handle, keys, count, values);
+}
+
+DLLEXPORT int FindKeys(const char *key, int min_score, int *candidates, int size)
+{
+    return Vt100FindKeys(vt100_handle, key, min_score, candidates, size);
+}
+
+DLLEXPORT int QueryEntries(const EntryQuery *query, int *entries, int size)
+{
+    return Vt100QueryEntries(vt100_handle, query, entries, size);
+}
+
+DLLEXPORT int GetPageEntry(int selectable_only, int idx, char *key, int key_size, char *value, int value_size)
+{
+    return Vt100GetPageEntry(vt100_handle, selectable_only, idx, key, key_size, value, value_size);
+}
+
+DLLEXPORT int PlanNavigation(const NavQuery *query, int *steps, int size)
+{
+    return Vt100PlanNavigation(vt100_handle, query, steps, size);
+}
+
+DLLEXPORT int FindText(const TextQuery *query, int *hits, int size)
+{
+    return Vt100FindText(vt100_handle, query, hits, size);
+}
+
+DLLEXPORT int GetPopups(int *boxes, int size)
+{
+    return Vt100GetPopups(vt100_handle, boxes, size);
+}
+
+DLLEXPORT ScreenStruct GetScreenColored()
+{
+    // the screen is copied before the lock is released, the results of the
+    // handle are changed by the calls of other threads
+    Vt100Handle *handle = vt100_handle;
+    if (handle == NULL)
+    {
+        cout << "Error: Need init" << endl;
+        return ScreenStruct();
+    }
+    lock_guard<mutex> guard(handle->lock);
+    return *handle->parser.GetScreenColored();
+}
+
+DLLEXPORT void GetScreenSize(int *height, int *width)
+{
+    Vt100GetScreenSize(vt100_handle, height, width);
+}
+
+DLLEXPORT int GetScreenPacked(uint8_t *buf, int size)
+{
+    return Vt100GetScreenPacked(vt100_handle, buf, size);
+}
+
+DLLEXPORT int GetScreenRowsPacked(int row_beg, int row_end, uint8_t *buf, int size)
+{
+    return Vt100GetScreenRowsPacked(vt100_handle, row_beg, row_end, buf, size);
+}
+
+DLLEXPORT SelectPage GetSelectPage()
+{
+    // copied under the lock as GetScreenColored()
+    Vt100Handle *handle = vt100_handle;
+    if (handle == NULL)
+    {
+        cout << "Error: vt100_screen_parser need init" << endl;
+        return SelectPage();
+    }
+    lock_guard<mutex> guard(handle->lock);
+    return *handle->parser.GetSelectablePage();
+}
+
+DLLEXPORT int GetSelectPagePacked(char *buf, int size)
+{
+    return Vt100GetSelectPagePacked(vt100_handle, buf, size);
+}
+
+DLLEXPORT const char *GetSelectPageBuffer(int *size)
+{
+    return Vt100GetSelectPageBuffer(vt100_handle, size);
+}
+
+DLLEXPORT int GetPageRecord(int format, int flags, char *buf, int size)
+{
+    return Vt100GetPageRecord(vt100_handle, format, flags, buf, size);
+}
+
+DLLEXPORT const char *GetPageRecordBuffer(int format, int flags, int *size)
+{
+    return Vt100GetPageRecordBuffer(vt100_handle, format, flags, size);
+}
+
+DLLEXPORT WholePage GetWholePage()
+{
+    // copied under the lock as GetScreenColored()
+    Vt100Handle *handle = vt100_handle;
+    if (handle == NULL)
+    {
+        cout << "Error: vt100_screen_parser need init" << endl;
+        return WholePage();
+    }
+    lock_guard<mutex> guard(handle->lock);
+    return *FillWholePage(handle);
 }
 
 DLLEXPORT bool CheckVt100Draw(char *data)
 {
     // cout << "this is check vt100 draw" << endl;
     DebugScreen debug_screen = DebugScreen();
-    std::vector<Vt100Cmd> debug_info = debug_screen.SerialOutputSplit(data);
+    std::vector<Vt100Cmd> debug_info;
+    debug_screen.SerialOutputSplit(data, strlen(data), debug_info, true, false, true);
     for (auto it = debug_info.begin(); it != debug_info.end(); it++)
     {
-        if ((it->description_ == "draw") && !(it->params_.size() == 1 && it->params_[0] == ""))
+        if (it->op_ == VT100_CMD_DRAW && it->length_ > 0)
             return true;
     }
     return false;
@@ -1468,36 +3766,12 @@ DLLEXPORT bool CheckVt100Draw(char *data)
 
 DLLEXPORT char *ParseEdkShell(char *input, bool remove_ec_logs)
 {
-    /*
-        Function Name       : parse_edk_shell()
-        Parameters          : inputs
-        Functionality       : parse the output of EDK/EFI shell serial output
-                              return string
-        Function Invoked    : DebugScreen.serial_output_split()
-        Return Value        : str
-    */
-    vector<Vt100Cmd> events;
-    string ret_str = "";
+    // the text is valid until the next ParseEdkShell(), the noise filter of
+    // Init() is used. It does not need Init(), the default patterns are used then
+    if (vt100_handle != NULL)
+        return Vt100ParseEdkShell(vt100_handle, input, remove_ec_logs);
+    lock_guard<mutex> guard(edk_shell_lock);
     DebugScreen debug_screen = DebugScreen(true);
-    string esc_parse = ParseWithoutEsc(input, events);
-    events = debug_screen.SerialOutputSplit(esc_parse, false, remove_ec_logs);
-
-    for (auto it = events.begin(); it != events.end(); it++)
-    {
-        Vt100Cmd event = *it;
-        if (event.description_ == "draw")
-        {
-            if (event.params_.size() == 1)
-                ret_str += event.params_[0];
-        }
-    }
-    if (edk_shell_string != NULL)
-    {
-        delete[] edk_shell_string;
-        edk_shell_string = NULL;
-    }
-
-    edk_shell_string = new char[ret_str.length() + 1];
-    Strcpy(edk_shell_string, ret_str, ret_str.length() + 1);
-    return edk_shell_string;
+    ParseEdkShellText(debug_screen, input, remove_ec_logs, edk_shell_text);
+    return &edk_shell_text[0];
 }
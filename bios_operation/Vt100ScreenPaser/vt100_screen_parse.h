@@ -19,8 +19,33 @@ Description : The header file of vt100_screen_parse.cpp
 #define FG_DEFAULT 39
 #define BG_DEFAULT 49
 #define TEXT_DEFAULT 0
+#define FG_BASE 30
+#define BG_BASE 40
+
+// the display attributes of a cell in one word: fg - FG_BASE in bits 0-3,
+// bg - BG_BASE in bits 4-7, the text attribute in bits 8-12
+typedef uint16_t CellAttr;
+#define CELL_ATTR(fg, bg, text) ((CellAttr)(((fg) - FG_BASE) | (((bg) - BG_BASE) << 4) | ((text) << 8)))
+#define CELL_FG(attr) (FG_BASE + ((attr) & 0x0f))
+#define CELL_BG(attr) (BG_BASE + (((attr) >> 4) & 0x0f))
+#define CELL_TEXT(attr) ((attr) >> 8)
 #define VT100_ESC "\x1b"
 
+// roles of the display attributes configured for the platform, a cell may
+// have more than one role
+#define CELL_ROLE_HIGHLIGHT 0
+#define CELL_ROLE_DISABLE 1
+#define CELL_ROLE_SUBTITLE 2
+#define CELL_ROLE_SELECTABLE 3
+#define CELL_ROLE_HIGHLIGHT_POPUP 4
+#define CELL_ROLE_COUNT 5
+#define ROW_MASK_WORDS 2 // one bit for each cell of a row, the rows are at most 128 cells
+#define SCREEN_BOX_INTS 7 // the ints written by GetPopups() for each box
+#define TEXT_HIT_INTS 5   // the ints written by FindText() for each hit
+#define KEY_CANDIDATE_INTS 2 // the ints written by FindKeys() for each candidate
+#define NAV_STEP_INTS 2   // the ints written by PlanNavigation() for each step
+#define SCREEN_CELL_BYTES 4 // the bytes written by GetScreenPacked() for each cell: char, fg, bg, text
+
 #define EntryType_UNKNOWN 0
 #define EntryType_MENU 1
 #define EntryType_DROP_DOWN 2
@@ -31,6 +56,25 @@ Description : The header file of vt100_screen_parse.cpp
 #define EntryType_DISABLE_TXT 7
 #define EntryType_SUBTITLE 8
 
+// how a text of an entry is matched by an EntryQuery
+#define TEXT_MATCH_ANY 0      // the text is not checked
+#define TEXT_MATCH_EQUAL 1    // the text is the pattern
+#define TEXT_MATCH_PREFIX 2   // the text starts with the pattern
+#define TEXT_MATCH_CONTAINS 3 // the pattern is in the text
+#define TEXT_MATCH_REGEX 4    // the ECMAScript regex is found in the text
+
+// the positions of the entries matched by an EntryQuery
+#define ENTRY_POS_ANY 0       // the position is not checked
+#define ENTRY_POS_INDEX 1     // the entries [pos_beg, pos_end]
+#define ENTRY_POS_HIGHLIGHT 2 // the entries [highlight_idx + pos_beg, highlight_idx + pos_end], none if no entry is highlighted
+
+// the keys pressed by a navigation plan
+#define NAV_KEY_UP 0
+#define NAV_KEY_DOWN 1
+#define NAV_KEY_PAGE_UP 2
+#define NAV_KEY_PAGE_DOWN 3
+#define NAV_KEY_ENTER 4
+
 struct ScreenStruct
 {
     int heigh;
@@ -67,46 +111,271 @@ struct SelectPage
     void Clear();
 };
 
-string ParseWithoutEsc(string byte_input, vector<Vt100Cmd> &events);
+// the page of GetSelectPage() packed by GetSelectPagePacked(): a PackedPage,
+// entries_count PackedEntry, then the chars of the texts. A text is at its
+// offset from the start of the page and is followed by a '\0'
+struct PackedText
+{
+    int offset;
+    int len;
+};
+
+#define PACKED_PAGE_SCROLLABLE_UP 0x01
+#define PACKED_PAGE_SCROLLABLE_DOWN 0x02
+#define PACKED_PAGE_DIALOG_BOX 0x04
+#define PACKED_PAGE_POPUP 0x08
+
+// the formats of the record of a page written by GetPageRecord()
+#define PAGE_RECORD_JSON 0
+#define PAGE_RECORD_MSGPACK 1
+#define PAGE_RECORD_ROWS 0x01 // a flag of GetPageRecord(): the rows of the screen are in the record
 
-struct ScreenCell
+struct PackedPage
 {
-    char content_;
-    int fg_color_;
-    int bg_color_;
-    int text_atr_;
+    int size; // the bytes of the packed page
+    int entries_count;
+    int highlight_idx;
+    int flags; // PACKED_PAGE_*
+    PackedText titles;
+    PackedText description;
+};
 
-    ScreenCell();
-    ScreenCell(char content, int fg_color, int bg_color, int text_atr);
-    void print();
+struct PackedEntry
+{
+    PackedText key;
+    PackedText value;
+    int type;
 };
 
+// the entries of a page matched by all the filters of the query
+struct EntryQuery
+{
+    int selectable_only; // the page of GetSelectPage(), else the page with the disabled entries and the subtitles
+    int types;           // bit 1 << EntryType_* of each type matched, 0 for all the types
+    int key_match;       // TEXT_MATCH_*
+    const char *key;
+    int value_match;
+    const char *value;
+    int ignore_case;     // of the key and the value
+    int pos_match;       // ENTRY_POS_*
+    int pos_beg;
+    int pos_end;
+};
+
+// a text searched in the cells of the screen
+struct TextQuery
+{
+    const char *pattern;
+    int ignore_case;
+    int row_beg; // the rows [row_beg, row_end), row_end -1 for all the rows after row_beg
+    int row_end;
+    int col_beg; // the hits are in the columns [col_beg, col_end), col_end -1 for all the columns after col_beg
+    int col_end;
+    int fg;      // the display attributes of every cell of a hit, -1 for any
+    int bg;
+    int text;
+};
+
+// the entry a navigation plan moves the highlight to, on the page of
+// GetPageEntry() with selectable_only 0, the subtitles and the disabled
+// entries are skipped by the arrows
+struct NavQuery
+{
+    int key_match;   // TEXT_MATCH_*, TEXT_MATCH_ANY for the entry target
+    const char *key; // the nearest entry whose key is matched
+    int ignore_case;
+    int target;      // the index of the entry
+    int wrap;        // the arrows wrap around at the first and the last entries if the page can't scroll
+    int page_jump;   // page up/down move to the first/last entry if the page can't scroll
+    int enter;       // press enter on the target
+};
+
+string ParseWithoutEsc(const string &byte_input, vector<Vt100Cmd> &events);
+size_t PrepareDrawText(const char *text, size_t len, char *out, bool *has_noise);
+
+// chars kept by others, such as a row of the screen, the analysis reads the
+// rows through views instead of copying them
+struct TextView
+{
+    const char *data_;
+    int len_;
+
+    TextView();
+    TextView(const char *data, int len);
+    TextView(const string &str);
+    TextView Sub(int beg, int len = -1) const; // clamped to the view as substr()
+    TextView Strip() const;                    // without the ' ' at both ends
+    TextView RStrip() const;
+    bool Empty() const;
+    int Find(char ch, int beg = 0) const; // -1 if not found
+    int Find(TextView text, int beg = 0) const;
+    bool StartsWith(const char *prefix) const;
+    bool EndsWith(const char *suffix) const;
+    bool operator==(const TextView &other) const;
+    bool operator!=(const TextView &other) const;
+};
+
+// the chars [beg_, beg_ + len_) of a TextArena
+struct TextSpan
+{
+    int beg_;
+    int len_;
+};
+
+// the chars of the entries of an analysed page, they are bump-allocated as
+// the page is analysed and reset with the page, the capacity is kept so an
+// analysis does not allocate once the arena has grown to a whole page
+class TextArena
+{
+private:
+    std::string chars_;
+
+public:
+    void Reset();
+    int Size() const;
+    void Assign(const TextArena &other, int len); // the first len chars of other
+    void Swap(TextArena &other);
+    TextSpan Append(TextView text); // the text must not be in this arena
+    TextSpan Join(TextSpan head, TextView tail); // head + tail, in place if head is the last span
+    TextView View(TextSpan span) const; // valid until the next Append() or Join()
+};
+
+// a run of cells in one row with the same display attributes, the text is
+// row_content_[row][beg_, end_), it is not copied into the run
 struct ScreenItem
 {
-    std::string content_;
     int beg_;
     int end_;
-    int fg_color_;
-    int bg_color_;
-    int text_atr_;
+    CellAttr attr_;
 
     ScreenItem();
-    ScreenItem(std::string content, int beg, int end, int fg_color, int bg_color, int text_atr);
+    ScreenItem(int beg, int end, CellAttr attr);
     void print();
 };
 
+// the cells of a row in each role and the cells which are not ' '
+struct RowMasks
+{
+    uint64_t role_[CELL_ROLE_COUNT][ROW_MASK_WORDS];
+    uint64_t non_blank_[ROW_MASK_WORDS];
+};
+
+// a border of a box in a row, /---\ at the top or \---/ at the bottom
+struct FrameBorder
+{
+    int beg_;   // the column of the left corner
+    int end_;   // the column after the right corner
+    char mark_; // the scroll mark in the border, '\0' if none
+};
+
+// the shapes of the lines of a platform layout
+#define LINE_DASHES 0      // count_ '-' anywhere in the row
+#define LINE_BORDER 1      // the whole row is left_ '-'... right_
+#define LINE_OPEN_BORDER 2 // the whole row is left_ '-' text '-' right_, the text may be empty
+#define LINE_BOX_BORDER 3  // left_ '-'... mark_ '-'... right_ anywhere in the row, the mark is optional
+#define LINE_PIPES 4       // '|' text '|' anywhere in the row
+#define LINE_TITLE 5       // spaces, a title, spaces anywhere in the row
+#define LINE_BOX_TITLE 6   // the whole row is '|' spaces, a title, spaces '|'
+
+// a line of the platform layout, it is built once in InitPlatformConfig()
+// and matches the rows as the regex of the line did, without the regex
+struct LineMatcher
+{
+    int shape_;
+    char left_;  // the corners of the borders
+    char right_;
+    char mark_;  // the scroll mark of LINE_BOX_BORDER
+    int count_;  // the '-' of LINE_DASHES
+
+    LineMatcher(int shape = LINE_DASHES, char left = '\0', char right = '\0', char mark = '\0', int count = 0);
+    // the first match from the column from, as the regex, the mark is '\0' if
+    // there is none, the whole row lines match only from the column 0
+    bool Find(const string &row, int from, FrameBorder *match = NULL) const;
+};
+
+// the borders found in a row when it is merged, the page analysis reads
+// them instead of matching the rows on every query
+struct RowFrame
+{
+    std::vector<FrameBorder> tops_;
+    std::vector<FrameBorder> bottoms_;
+    bool header_top_;
+    bool header_bottom_;
+    bool footer_top_;
+    bool footer_bottom_;
+    bool popup_mid_;
+};
+
+// a text found in the cells of the screen
+struct TextHit
+{
+    int row_;
+    int col_;       // of the first cell
+    CellAttr attr_; // of the first cell
+};
+
+// an entry whose key is like a key looked up
+struct KeyCandidate
+{
+    int entry_; // the index of the entry, as GetPageEntry()
+    int score_; // 0 - 100 of the trigrams shared by the keys, 100 if they are the same
+};
+
+// a key of a navigation plan
+struct NavStep
+{
+    int key_;           // NAV_KEY_*
+    int highlight_idx_; // expected after the key, -1 if unknown
+};
+
+// a box drawn in the workspace
+struct ScreenBox
+{
+    int top_; // the rows of the top and the bottom borders
+    int bottom_;
+    int beg_; // the column of the left corner
+    int end_; // the column after the right corner
+    int depth_; // the number of the boxes it is drawn in
+    bool scroll_up_;
+    bool scroll_down_;
+};
+
 class Vt100ScreenParser
 {
 private:
     std::vector<std::vector<ScreenItem>> screen_info_;
+    std::vector<string> row_content_; // text of each row of screen_info_
+    std::vector<RowFrame> row_frames_; // box borders of each row of screen_info_
+    bool screen_info_stale_;          // Feed() is called after the last MergeScreenInfo()
+    std::vector<bool> row_stale_;     // the rows of the cells changed after the last MergeScreenInfo()
+    std::vector<bool> row_dirty_;     // the rows may be changed after the last ClearDirtyRows()
+    std::vector<char> dirty_base_chars_;     // the cells at the last ClearDirtyRows()
+    std::vector<CellAttr> dirty_base_attrs_;
     DebugScreen debug_screen_;
+    DebugScreen edk_shell_screen_; // of ParseEdkShell(), it has the noise filter patterns of debug_screen_
 
     std::vector<Vt100Cmd> buff_;
-    std::vector<std::vector<ScreenCell>> char_matrix_;
+    std::vector<char> draw_buff_;
+    // the cells, height_ x width_ in row-major order
+    std::vector<char> screen_chars_;
+    std::vector<CellAttr> screen_attrs_;
+    std::vector<RowMasks> row_masks_; // kept as the cells are written
+    unsigned long long generation_;   // bumped when a cell is changed
+    std::vector<unsigned long long> row_generation_; // the generation each row is changed at
+
+    // the cells drawn by the bytes the noise filter keeps at the end of the
+    // last Feed(), they are taken back before the next Feed()
+    bool held_drawn_;
+    int held_cursor_[5];          // cur_row_, cur_col_, cur_fg_, cur_bg_, cur_text_attribute_ before
+    std::vector<int> held_rows_;  // the rows drawn and their cells before
+    std::vector<char> held_chars_;
+    std::vector<CellAttr> held_attrs_;
 
     int cur_fg_;
     int cur_bg_;
     int cur_text_attribute_;
+    int cur_row_;
+    int cur_col_;
 
     int width_;
     int height_;
@@ -147,71 +416,32 @@ private:
     int workspace_beg_;
     int workspace_end_;
 
-    std::regex *header_regex_top_ = NULL;
-    std::regex *header_regex_mid_ = NULL;
-    std::regex *header_regex_bottom_ = NULL;
-    std::regex *footer_regex_top_ = NULL;
-    std::regex *footer_regex_mid_ = NULL;
-    std::regex *footer_regex_bottom_ = NULL;
-    std::regex *popup_regex_top_ = NULL;
-    std::regex *popup_regex_mid_ = NULL;
-    std::regex *popup_regex_bottom_ = NULL;
-
-    std::unordered_map<int, std::string> FG;
-    std::unordered_map<int, std::string> BG;
-    std::unordered_map<int, std::string> TEXT;
-    std::unordered_map<std::string, int> FG_INV;
-    std::unordered_map<std::string, int> BG_INV;
-    std::unordered_map<std::string, int> TEXT_INV;
-
-    const std::unordered_map<int, std::string> FG_ANSI = {
-        {30, "black"},
-        {31, "red"},
-        {32, "green"},
-        {33, "brown"},
-        {34, "blue"},
-        {35, "magenta"},
-        {36, "cyan"},
-        {37, "white"},
-        {39, "default"} // white.
-    };
-
-    const std::unordered_map<int, std::string> BG_ANSI = {
-        {40, "black"},
-        {41, "red"},
-        {42, "green"},
-        {43, "brown"},
-        {44, "blue"},
-        {45, "magenta"},
-        {46, "cyan"},
-        {47, "white"},
-        {49, "default"} // black.
-    };
-
-    const std::unordered_map<int, std::string> TEXT_ANSI = {
-        {0, "default"},
-        {1, "+bold"},
-        {3, "+italics"},
-        {4, "+underscore"},
-        {7, "+reverse"},
-        {9, "+strikethrough"},
-        {22, "-bold"},
-        {23, "-italics"},
-        {24, "-underscore"},
-        {27, "-reverse"},
-        {29, "-strikethrough"},
-    };
-
+    // the rows read to find the header and the footer, the page is patched
+    // only if the rows between them are changed
+    int header_rows_end_;
+    int footer_rows_beg_;
+
+    LineMatcher header_line_top_;
+    LineMatcher header_line_mid_;
+    LineMatcher header_line_bottom_;
+    LineMatcher footer_line_top_;
+    LineMatcher footer_line_bottom_;
+    LineMatcher popup_line_top_;
+    LineMatcher popup_line_mid_;
+    LineMatcher popup_line_bottom_;
+
+    // the key and the value are in the text of the page
     struct Entry
     {
-        std::string key;
-        std::string value;
+        TextSpan key;
+        TextSpan value;
         int type;
     };
 
     struct Page
     {
         vector<Entry> entries;
+        TextArena text; // the chars of the entries
         std::string titles;
         std::string description;
         int highlight_idx;
@@ -221,45 +451,160 @@ private:
         bool is_popup;
     };
 
+    // state of non_popup_parse() at the first row of a step, a step parses
+    // one entry or the rows of one entry which are appended to the last one
+    struct PageStep
+    {
+        int row;
+        int entries_count;
+        int highlight_idx;
+        int desc_len;
+        int text_len; // of the text of the page
+        bool merged;  // the step appends its rows to the last entry
+    };
+
+    // the keys of the entries of a page stripped and upper-cased, built at
+    // the first key lookup after the page is analysed
+    struct KeyIndex
+    {
+        TextArena text;
+        vector<TextSpan> keys;         // of each entry
+        unsigned long long generation; // of the page it is built for
+        // the trigrams of the keys, built at the first fuzzy lookup of the page
+        bool has_trigrams;
+        vector<uint64_t> trigrams;   // trigram << 32 | entry, sorted
+        vector<int> trigram_counts;  // of each entry
+    };
+
+    struct PageCache
+    {
+        Page page;
+        KeyIndex index;
+        unsigned long long generation; // the generation the page is analysed at
+        int entry_beg;                 // the rows of the entries, -1 if the page can't be patched
+        int entry_end;
+        vector<PageStep> steps;
+    };
+
+    // the steps and the entries of the cached page after the first changed
+    // row, they are reused once the steps parsed again are in the same state
+    struct PagePatch
+    {
+        int last_row;      // the last changed row
+        int entries_count; // the entries before the steps parsed again
+        int highlight_idx; // of the cached page
+        vector<Entry> entries;
+        TextArena text; // of the cached page, the entries are in it
+        std::string description;
+        vector<PageStep> steps;
+        size_t next_step;
+    };
+
+    // the page analysed at a generation, indexed by selectable_only and kv_sep
+    PageCache page_cache_[2][2];
+    PagePatch page_patch_; // kept to reuse its buffers
+
+    // the key, the value and the description joined from the rows of an
+    // entry, reused by every analysis
+    std::string key_join_;
+    std::string value_join_;
+    std::string desc_join_;
+    std::string kv_join_;
+
+    ScreenStruct screen_;         // of GetScreenColored()
+    SelectPage select_page_;      // of GetSelectablePage()
+    std::string page_record_;     // of GetPageRecord(), kept until the screen is changed
+    unsigned long long record_generation_;
+    int record_format_;
+    int record_flags_;
+
+    std::string key_query_;       // the key looked up, upper-cased
+    std::string key_values_;      // the values found by the last key lookup
+    vector<int> key_values_beg_;  // of the values of each key in key_values_
+    vector<int> key_trigrams_;    // of the key looked up by FindKeys()
+    vector<int> key_shared_;      // the trigrams each entry shares with the key
+
     void InitPlatformConfig();
     void InitScreenInfo();
     void InitCharMatrix();
-    std::string CharReplace(std::string str);
-    void ParseScreen();
-    void InsertScreenInfo(int row, ScreenItem item);
+    void ParseScreen(const char *input);
+    void DrawHeld();
+    void TakeBackHeld();
+    void ReleaseHeld();
+    int InsertScreenInfo(int row, int beg, const char *text, size_t len);
+    unsigned char GetAttrRoles(CellAttr attr);
+    void UpdateRowMasks(int row, int beg, int end, CellAttr attr);
     void MergeScreenInfo();
+    void UpdateRowFrame(int row);
+    void FindBorders(const string &content, const LineMatcher &line, vector<FrameBorder> &borders);
+    void UpdateScreenInfo();
 
-    string GetRowContent(int row_no);
+    const string &GetRowContent(int row_no);
     bool CheckRowFgBgText(int idx, int fg = -1, int bg = -1, int text = -1, int beg = 0, int end = -1);
     bool CheckExistRowFgBgText(int idx, int fg = -1, int bg = -1, int text = -1, int beg = 0, int end = -1, bool non_whitespace = true);
+    bool CheckExistRole(int role, int idx, int beg, int end, bool non_whitespace);
     bool CheckExistDisable(int idx, int beg = 0, int end = -1, bool non_whitespace = true);
     bool CheckExistSubtitle(int idx, int beg = 0, int end = -1, bool non_whitespace = true);
     bool CheckExistHighlight(int idx, int beg = 0, int end = -1, bool non_whitespace = true);
     bool CheckExistHighlightPopup(int idx, int beg = 0, int end = -1, bool non_whitespace = true);
+    bool CheckExistSelectable(int idx, int beg = 0, int end = -1, bool non_whitespace = true);
     bool IsScrollableUp();
     bool IsScrollableDown();
     void InitWorkspace();
     void InitFooter();
     void InitHeader(Vt100ScreenParser::Page &page_ret);
 
-    int String2Num(std::string str, int widthOrheight);
-    Page get_whole_page_info(bool selectable_only, bool kv_sep);
+    int ParamToNum(short param, bool from_end, int widthOrheight);
+    const Page &get_whole_page_info(bool selectable_only, bool kv_sep);
+    const KeyIndex &GetKeyIndex(bool selectable_only, bool kv_sep);
+    void AppendValuesByKey(const Page &page, const KeyIndex &index, TextView key, std::string &values);
+    void IndexKeyTrigrams(KeyIndex &index);
     void InitPageDict(Vt100ScreenParser::Page &page);
     bool check_screen_available();
-    void GetCompleteHighlightKeyThruRows(string *key, string *desc, int *idx);
-    void GetCompleteKvThruRows(string *key, string *value, string *desc, int *idx, bool is_disable = false);
+    void GetCompleteHighlightKeyThruRows(TextView *key, TextView *desc, int *idx);
+    void GetCompleteKvThruRows(TextView *key, TextView *value, TextView *desc, int *idx, bool is_disable = false);
 
     bool popup_parse(Vt100ScreenParser::Page &page);
-    void non_popup_parse(Vt100ScreenParser::Page &page, bool selectable_only = true, bool kv_sep = false);
+    void non_popup_parse(Vt100ScreenParser::Page &page, vector<PageStep> &steps, bool selectable_only = true, bool kv_sep = false);
+    void ParseEntries(Vt100ScreenParser::Page &page, vector<PageStep> &steps, int idx, bool selectable_only, bool kv_sep, PagePatch *patch = NULL);
+    bool ResumePatch(Vt100ScreenParser::Page &page, vector<PageStep> &steps, int idx, PagePatch *patch);
+    bool PatchPage(PageCache &cache, bool selectable_only, bool kv_sep);
 
 public:
     Vt100ScreenParser(std::string platform);
     void CleanScreenData();
-    void Feed(std::string input);
+    void SetSplitEngine(int engine);
+    bool LoadNoiseFilter(const std::string &file);
+    int GetNoiseFilterHits(const std::string &pattern);
+    void ParseEdkShell(const char *input, bool remove_ec_logs, std::string &text);
+    void Feed(const std::string &input);
+    void FeedBytes(const uint8_t *data, size_t len);
+    void FeedBytes(ByteSpan bytes);
+    vector<int> GetDirtyRows();
+    void ClearDirtyRows();
     ScreenStruct *GetScreenColored();
+    int GetScreenPacked(int row_beg, int row_end, uint8_t *buf, int size);
     int GetWidth();
     int GetHeight();
+    // the cells, height x width in row-major order, at the same address for
+    // the life of the parser
+    const char *GetScreenChars();
+    const CellAttr *GetScreenAttrs();
     vector<string> GetWholePage();
+    vector<ScreenBox> GetPopups();
+    int FindText(const TextQuery &query, vector<TextHit> &hits);
     SelectPage *GetSelectablePage();
+    int GetSelectPagePacked(char *buf, int size);
+    const std::string *GetPageRecord(int format, int flags);
     char *GetValueByKey(std::string key);
+    int GetValuesByKeys(const char *const *keys, int count, const char **values);
+    int FindKeys(TextView key, int min_score, vector<KeyCandidate> &candidates);
+    int QueryEntries(const EntryQuery &query, vector<int> &entries);
+    int GetPageEntry(bool selectable_only, int idx, TextView *key, TextView *value);
+    int PlanNavigation(const NavQuery &query, vector<NavStep> &steps);
 };
+
+// a parser with the results of the exports for it. The exports named Vt100*()
+// take a handle, so the consoles are parsed in parallel threads, the calls on
+// one handle are serialised. The other exports use the handle of Init()
+struct Vt100Handle;